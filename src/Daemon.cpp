@@ -0,0 +1,370 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Daemon.h"
+#include "exceptions.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <glibmm/convert.h>
+#include <glibmm/miscutils.h>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr const char* eventKey = "event";
+constexpr const char* idKey = "id";
+constexpr const char* sourceKey = "source";
+constexpr const char* progressKey = "progress";
+constexpr const char* successKey = "success";
+constexpr const char* messageKey = "message";
+
+constexpr int listenBacklog = 16;
+constexpr size_t readChunkSize = 4096;
+constexpr size_t maxRequestSize = 1024 * 1024;
+constexpr size_t maxPendingOutputSize = 1024 * 1024;
+constexpr unsigned int progressIntervalInMs = 500;
+
+Glib::ustring toUri(const std::string& source)
+{
+    if (Glib::path_is_absolute(source))
+    {
+        return Glib::filename_to_uri(source);
+    }
+
+    return source;
+}
+} // namespace
+
+Daemon::Daemon(const std::shared_ptr<TranscoderPool>& pool, const std::string& socketPath,
+               const std::string& outputDir)
+    : m_pool(pool), m_socketPath(socketPath), m_outputDir(outputDir), m_socket(-1), m_stopping(false)
+{
+    m_mainLoop = Glib::MainLoop::create();
+    if (!m_pool || !m_mainLoop)
+    {
+        throw UnrecoverableError();
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (m_socketPath.empty() || (m_socketPath.size() >= sizeof(address.sun_path)))
+    {
+        throw CannotOpenSocketException();
+    }
+    m_socketPath.copy(address.sun_path, m_socketPath.size()); // NOLINT
+
+    // A socket left behind by a previous instance would prevent binding, but
+    // any other kind of file at this path must be left untouched.
+    struct stat info = {};
+    if ((lstat(m_socketPath.c_str(), &info) == 0) && S_ISSOCK(info.st_mode)) // NOLINT
+    {
+        unlink(m_socketPath.c_str());
+    }
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_socket < 0)
+    {
+        throw CannotOpenSocketException();
+    }
+
+    if ((bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) || // NOLINT
+        (listen(m_socket, listenBacklog) != 0))
+    {
+        std::cerr << "Cannot listen on " << m_socketPath << ": " << strerror(errno) << std::endl;
+        close(m_socket);
+        throw CannotOpenSocketException();
+    }
+}
+
+Daemon::~Daemon()
+{
+    m_acceptWatch.disconnect();
+    m_progressTimer.disconnect();
+    for (auto& client : m_clients)
+    {
+        client->watch.disconnect();
+        client->writeWatch.disconnect();
+    }
+    m_clients.clear();
+
+    close(m_socket);
+    unlink(m_socketPath.c_str());
+}
+
+void Daemon::run()
+{
+    m_acceptWatch = Glib::signal_io().connect(sigc::mem_fun(*this, &Daemon::onAccept), m_socket, Glib::IO_IN);
+    m_progressTimer =
+        Glib::signal_timeout().connect(sigc::mem_fun(*this, &Daemon::onProgressTimeout), progressIntervalInMs);
+
+    std::cout << "Waiting for jobs on " << m_socketPath << "..." << std::endl;
+    m_mainLoop->run();
+
+    m_acceptWatch.disconnect();
+    m_progressTimer.disconnect();
+}
+
+void Daemon::stop() noexcept
+{
+    // Running jobs are interrupted and the main loop is left from the
+    // progress timer, once all outputs have been correctly finalized.
+    m_stopping = true;
+    m_acceptWatch.disconnect();
+    m_pool->interruptTranscoding();
+}
+
+bool Daemon::onAccept(Glib::IOCondition /*condition*/) noexcept
+{
+    // Client sockets are non-blocking, so that a slow or stalled client can
+    // never freeze the main loop, neither on a partial request nor on events.
+    const int fd = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot accept client: " << strerror(errno) << std::endl;
+        return true;
+    }
+
+    try
+    {
+        auto client = std::make_shared<Client>();
+        client->fd = fd;
+        client->channel = Glib::IOChannel::create_from_fd(fd);
+        client->channel->set_close_on_unref(true);
+        client->channel->set_encoding("");
+        client->channel->set_buffered(false);
+        client->channel->set_flags(Glib::IO_FLAG_NONBLOCK);
+
+        std::weak_ptr<Client> weakClient = client;
+        client->watch = Glib::signal_io().connect(
+            [this, weakClient](Glib::IOCondition condition) {
+                auto client = weakClient.lock();
+                return client && onClientReadable(client, condition);
+            },
+            client->channel, Glib::IO_IN | Glib::IO_HUP | Glib::IO_ERR);
+
+        m_clients.push_back(client);
+    }
+    catch (const Glib::Error& e)
+    {
+        std::cerr << "Cannot accept client: " << e.what() << std::endl;
+        close(fd);
+    }
+
+    return true;
+}
+
+bool Daemon::onClientReadable(const std::shared_ptr<Client>& client, Glib::IOCondition /*condition*/) noexcept
+{
+    try
+    {
+        // Requests are accumulated until complete, a request may arrive in
+        // several reads and a single read may hold several requests.
+        std::array<char, readChunkSize> buffer{};
+        gsize count = 0;
+        const auto status = client->channel->read(buffer.data(), buffer.size(), count);
+        if (status == Glib::IO_STATUS_AGAIN)
+        {
+            return true;
+        }
+
+        if (status != Glib::IO_STATUS_NORMAL)
+        {
+            removeClient(client);
+            return false;
+        }
+        client->input.append(buffer.data(), count);
+
+        size_t end = 0;
+        while ((end = client->input.find('\n')) != std::string::npos)
+        {
+            const auto line = client->input.substr(0, end);
+            client->input.erase(0, end + 1);
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+            {
+                processRequest(client, line);
+            }
+
+            if (client->fd < 0)
+            {
+                return false;
+            }
+        }
+
+        if (client->input.size() > maxRequestSize)
+        {
+            std::cerr << "Client request too large, disconnecting" << std::endl;
+            removeClient(client);
+            return false;
+        }
+    }
+    catch (const Glib::Error& e)
+    {
+        std::cerr << "Cannot read client request: " << e.what() << std::endl;
+        removeClient(client);
+        return false;
+    }
+
+    return true;
+}
+
+bool Daemon::onClientWritable(const std::shared_ptr<Client>& client, Glib::IOCondition /*condition*/) noexcept
+{
+    return flush(client) && !client->output.empty();
+}
+
+bool Daemon::onProgressTimeout() noexcept
+{
+    // Clients may be dropped while sending.
+    const auto clients = m_clients;
+    for (const auto& client : clients)
+    {
+        const auto jobs = client->jobs;
+        for (auto id : jobs)
+        {
+            send(client, {{eventKey, progressKey}, {idKey, id}, {progressKey, m_pool->getProgress(id)}});
+        }
+    }
+
+    if (m_stopping && (m_pool->getRunningCount() == 0))
+    {
+        m_mainLoop->quit();
+    }
+
+    return true;
+}
+
+void Daemon::processRequest(const std::shared_ptr<Client>& client, const std::string& request)
+{
+    try
+    {
+        if (m_stopping)
+        {
+            throw InvalidStateException();
+        }
+
+        Json job = Json::parse(request);
+        const auto sources = job.at(sourcesKey).get<std::vector<std::string>>();
+        const auto outputDir = job.value(outputDirKey, m_outputDir);
+        job.erase(sourcesKey);
+        job.erase(outputDirKey);
+
+        // Jobs only override some settings of the transcoder configuration
+        // the daemon was started with, the rest is kept.
+        Json config = m_pool->serialize();
+        config.merge_patch(job);
+
+        std::weak_ptr<Client> weakClient = client;
+        auto slotFinished = [this, weakClient](unsigned long id, const Glib::ustring& uri, bool isSuccess) {
+            auto client = weakClient.lock();
+            if (client)
+            {
+                client->jobs.erase(id);
+                send(client, {{eventKey, "finished"}, {idKey, id}, {sourceKey, uri.raw()}, {successKey, isSuccess}});
+            }
+        };
+
+        for (const auto& source : sources)
+        {
+            const auto uri = toUri(source);
+            const auto id = m_pool->enqueue(uri, config, outputDir, slotFinished);
+            client->jobs.insert(id);
+            send(client, {{eventKey, "accepted"}, {idKey, id}, {sourceKey, uri.raw()}});
+        }
+
+        m_pool->dispatch();
+    }
+    catch (const std::exception& e)
+    {
+        send(client, {{eventKey, "error"}, {messageKey, e.what()}});
+    }
+}
+
+void Daemon::removeClient(const std::shared_ptr<Client>& client) noexcept
+{
+    // Jobs of a disconnected client keep running, only their events are lost.
+    client->watch.disconnect();
+    client->writeWatch.disconnect();
+    client->fd = -1;
+    client->channel.reset();
+    client->input.clear();
+    client->output.clear();
+    m_clients.erase(std::remove(m_clients.begin(), m_clients.end(), client), m_clients.end());
+}
+
+void Daemon::send(const std::shared_ptr<Client>& client, const Json& event) noexcept
+{
+    if (client->fd < 0)
+    {
+        return;
+    }
+
+    // Events not accepted by the socket yet are kept until it is writable
+    // again, a client not reading them fast enough is dropped.
+    client->output += event.dump() + '\n';
+    if (client->output.size() > maxPendingOutputSize)
+    {
+        std::cerr << "Client not reading its events, disconnecting" << std::endl;
+        removeClient(client);
+        return;
+    }
+
+    if (!client->writeWatch.connected() && flush(client) && !client->output.empty())
+    {
+        std::weak_ptr<Client> weakClient = client;
+        client->writeWatch = Glib::signal_io().connect(
+            [this, weakClient](Glib::IOCondition condition) {
+                auto client = weakClient.lock();
+                return client && onClientWritable(client, condition);
+            },
+            client->fd, Glib::IO_OUT);
+    }
+}
+
+bool Daemon::flush(const std::shared_ptr<Client>& client) noexcept
+{
+    // Events are written directly to the socket, bypassing the channel, so
+    // that a vanished client results in an error instead of a SIGPIPE.
+    while (!client->output.empty())
+    {
+        const auto count = ::send(client->fd, client->output.data(), client->output.size(), MSG_NOSIGNAL); // NOLINT
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+
+            removeClient(client);
+            return false;
+        }
+        client->output.erase(0, static_cast<size_t>(count));
+    }
+
+    return true;
+}
@@ -0,0 +1,73 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "TranscoderPool.h"
+#include <glibmm/iochannel.h>
+#include <set>
+
+class Daemon final
+{
+  public:
+    static constexpr const char* sourcesKey = "sources";
+    static constexpr const char* outputDirKey = "outputdir";
+
+    Daemon(const std::shared_ptr<TranscoderPool>& pool, const std::string& socketPath,
+           const std::string& outputDir = std::string());
+    ~Daemon();
+
+    Daemon(const Daemon&) = delete;
+    Daemon& operator=(const Daemon&) = delete;
+    Daemon(Daemon&&) = delete;
+    Daemon& operator=(Daemon&&) = delete;
+
+    void run();
+    void stop() noexcept;
+
+  private:
+    struct Client
+    {
+        int fd = -1;
+        Glib::RefPtr<Glib::IOChannel> channel;
+        sigc::connection watch;
+        sigc::connection writeWatch;
+        std::string input;
+        std::string output;
+        std::set<unsigned long> jobs;
+    };
+
+    std::shared_ptr<TranscoderPool> m_pool;
+    std::string m_socketPath;
+    std::string m_outputDir;
+    int m_socket;
+    Glib::RefPtr<Glib::MainLoop> m_mainLoop;
+    sigc::connection m_acceptWatch;
+    sigc::connection m_progressTimer;
+    std::vector<std::shared_ptr<Client>> m_clients;
+    bool m_stopping;
+
+    bool onAccept(Glib::IOCondition condition) noexcept;
+    bool onClientReadable(const std::shared_ptr<Client>& client, Glib::IOCondition condition) noexcept;
+    bool onClientWritable(const std::shared_ptr<Client>& client, Glib::IOCondition condition) noexcept;
+    bool onProgressTimeout() noexcept;
+    void processRequest(const std::shared_ptr<Client>& client, const std::string& request);
+    void removeClient(const std::shared_ptr<Client>& client) noexcept;
+    void send(const std::shared_ptr<Client>& client, const Json& event) noexcept;
+    bool flush(const std::shared_ptr<Client>& client) noexcept;
+};
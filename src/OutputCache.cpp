@@ -0,0 +1,277 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "OutputCache.h"
+#include "exceptions.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <glibmm.h>
+#include <gst/gst.h>
+#include <iostream>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+namespace
+{
+// The source hash reads evenly spaced samples of the file instead of the
+// whole file, along with its size and modification time, so that an edit
+// outside of the samples still changes the hash.
+constexpr std::uint64_t sampleSize = 64 * 1024;
+constexpr std::uint64_t sampleCount = 16;
+
+// Entries live in a subdirectory owned by the cache, so that files the user
+// keeps in the cache directory are never evicted.
+constexpr const char* entriesDirName = "entries";
+constexpr size_t keyLength = 64;
+
+std::string getPluginVersions()
+{
+    std::vector<std::string> versions;
+    GList* plugins = gst_registry_get_plugin_list(gst_registry_get());
+    for (GList* it = plugins; it != nullptr; it = it->next)
+    {
+        auto* plugin = static_cast<GstPlugin*>(it->data);
+        versions.push_back(std::string(gst_plugin_get_name(plugin)) + ":" + gst_plugin_get_version(plugin));
+    }
+    gst_plugin_list_free(plugins);
+
+    std::sort(versions.begin(), versions.end());
+    gchar* core = gst_version_string();
+    std::string result = core;
+    g_free(core);
+    for (const auto& version : versions)
+    {
+        result += "," + version;
+    }
+    return result;
+}
+
+bool cloneFile(const std::string& from, const std::string& to) noexcept
+{
+    const int in = open(from.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT
+    if (in < 0)
+    {
+        return false;
+    }
+
+    const int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644); // NOLINT
+    const bool isCloned = (out >= 0) && (ioctl(out, FICLONE, in) == 0);                 // NOLINT
+    close(in);
+    if (out >= 0)
+    {
+        close(out);
+    }
+    return isCloned;
+}
+
+// Cached entries and outputs never share their inode, so that rewriting an
+// output in place can't corrupt the cache, nor the other way round. Copies
+// are reflinks on filesystems supporting them.
+bool copyFile(const std::string& from, const std::string& to) noexcept
+{
+    if (cloneFile(from, to))
+    {
+        return true;
+    }
+
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    if (!in || !out)
+    {
+        return false;
+    }
+
+    out << in.rdbuf();
+    return static_cast<bool>(out);
+}
+
+// Keys are SHA-256 digests, anything else (temporary files of concurrent
+// stores for instance) is not an entry.
+bool isKey(const std::string& name) noexcept
+{
+    return (name.size() == keyLength) &&
+           std::all_of(name.begin(), name.end(), [](char c) { return g_ascii_isxdigit(c) != FALSE; });
+}
+} // namespace
+
+OutputCache::OutputCache(const std::string& dir, std::uint64_t maxSize)
+    : m_directory(Glib::build_filename(dir, entriesDirName)), m_maxSize(maxSize), m_hitCount(0), m_missCount(0),
+      m_evictionCount(0)
+{
+    if (g_mkdir_with_parents(m_directory.c_str(), 0755) != 0)
+    {
+        throw InvalidValueException();
+    }
+
+    m_versions = getPluginVersions();
+}
+
+std::string OutputCache::hashSource(const Glib::ustring& uri) const
+{
+    if (Glib::uri_parse_scheme(uri) != "file")
+    {
+        return std::string();
+    }
+
+    const auto path = Glib::filename_from_uri(uri);
+    struct stat info = {};
+    std::ifstream in(path, std::ios::binary);
+    if ((stat(path.c_str(), &info) != 0) || !in)
+    {
+        return std::string();
+    }
+
+    Glib::Checksum checksum(Glib::Checksum::CHECKSUM_SHA256);
+    const auto size = static_cast<std::uint64_t>(info.st_size);
+    checksum.update(std::to_string(size));
+    checksum.update(std::to_string(info.st_mtim.tv_sec) + "." + std::to_string(info.st_mtim.tv_nsec));
+
+    std::vector<char> buffer(sampleSize);
+    const std::uint64_t step = (size > sampleSize * sampleCount) ? (size - sampleSize) / (sampleCount - 1) : sampleSize;
+    for (std::uint64_t offset = 0; offset < size; offset += step)
+    {
+        in.seekg(static_cast<std::streamoff>(offset));
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        checksum.update(reinterpret_cast<const guchar*>(buffer.data()), in.gcount()); // NOLINT
+        in.clear();
+    }
+
+    return checksum.get_string();
+}
+
+std::string OutputCache::getKey(const std::string& sourceHash, const Json& settings) const
+{
+    // Json objects are sorted by key, so their dump is canonical.
+    Glib::Checksum checksum(Glib::Checksum::CHECKSUM_SHA256);
+    checksum.update(sourceHash);
+    checksum.update(settings.dump());
+    checksum.update(m_versions);
+    return checksum.get_string();
+}
+
+bool OutputCache::contains(const std::string& key) const noexcept
+{
+    return Glib::file_test(getPath(key), Glib::FILE_TEST_IS_REGULAR);
+}
+
+bool OutputCache::fetch(const std::string& key, const std::string& outputFile) noexcept
+{
+    // A previous output is replaced rather than overwritten, in case it is
+    // still being read.
+    const auto path = getPath(key);
+    std::remove(outputFile.c_str());
+    if (!copyFile(path, outputFile))
+    {
+        std::remove(outputFile.c_str());
+        return false;
+    }
+
+    // Least recently used entries are evicted first.
+    utime(path.c_str(), nullptr);
+    ++m_hitCount;
+    return true;
+}
+
+void OutputCache::store(const std::string& key, const std::string& outputFile) noexcept
+{
+    const auto path = getPath(key);
+    const auto tmpPath = path + ".tmp";
+    std::remove(tmpPath.c_str());
+    if (copyFile(outputFile, tmpPath) && (std::rename(tmpPath.c_str(), path.c_str()) == 0))
+    {
+        evict();
+    }
+    else
+    {
+        std::remove(tmpPath.c_str());
+    }
+}
+
+void OutputCache::printSummary() const
+{
+    std::cout << "Output cache: " << m_hitCount << " hit(s), " << m_missCount << " miss(es), " << m_evictionCount
+              << " eviction(s)." << std::endl;
+}
+
+std::string OutputCache::getPath(const std::string& key) const
+{
+    return Glib::build_filename(m_directory, key);
+}
+
+void OutputCache::evict() noexcept
+{
+    if (m_maxSize == 0)
+    {
+        return;
+    }
+
+    struct Entry
+    {
+        std::string path;
+        std::uint64_t size;
+        time_t lastUse;
+    };
+
+    try
+    {
+        std::vector<Entry> entries;
+        std::uint64_t totalSize = 0;
+        Glib::Dir dir(m_directory);
+        for (const auto& name : dir)
+        {
+            if (!isKey(name))
+            {
+                continue;
+            }
+
+            const auto path = Glib::build_filename(m_directory, name);
+            struct stat info = {};
+            if ((stat(path.c_str(), &info) == 0) && S_ISREG(info.st_mode)) // NOLINT
+            {
+                entries.push_back({path, static_cast<std::uint64_t>(info.st_size), info.st_mtime});
+                totalSize += entries.back().size;
+            }
+        }
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+        for (const auto& entry : entries)
+        {
+            if (totalSize <= m_maxSize)
+            {
+                break;
+            }
+
+            if (std::remove(entry.path.c_str()) == 0)
+            {
+                totalSize -= entry.size;
+                ++m_evictionCount;
+            }
+        }
+    }
+    catch (const Glib::Error& e)
+    {
+        std::cerr << "Cannot evict cached outputs: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "ISerializable.h"
+#include <cstdint>
+#include <glibmm/ustring.h>
+#include <string>
+
+// Transcoded outputs indexed by the content and modification time of their
+// source, their settings and the installed GStreamer plugins versions, so
+// that transcoding the same source again with the same settings only copies
+// previous outputs.
+class OutputCache final
+{
+  public:
+    // maxSize in bytes, 0 = unlimited.
+    OutputCache(const std::string& dir, std::uint64_t maxSize);
+    ~OutputCache() = default;
+
+    OutputCache(const OutputCache&) = delete;
+    OutputCache& operator=(const OutputCache&) = delete;
+    OutputCache(OutputCache&&) = delete;
+    OutputCache& operator=(OutputCache&&) = delete;
+
+    // Fast hash of the source content and modification time, empty if it is
+    // not a local file.
+    std::string hashSource(const Glib::ustring& uri) const;
+    std::string getKey(const std::string& sourceHash, const Json& settings) const;
+
+    bool contains(const std::string& key) const noexcept;
+    bool fetch(const std::string& key, const std::string& outputFile) noexcept;
+    void store(const std::string& key, const std::string& outputFile) noexcept;
+    void countMiss() noexcept
+    {
+        ++m_missCount;
+    }
+
+    void printSummary() const;
+
+  private:
+    std::string m_directory;
+    std::uint64_t m_maxSize;
+    std::string m_versions;
+    unsigned int m_hitCount;
+    unsigned int m_missCount;
+    unsigned int m_evictionCount;
+
+    std::string getPath(const std::string& key) const;
+    void evict() noexcept;
+};
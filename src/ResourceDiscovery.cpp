@@ -0,0 +1,242 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ResourceDiscovery.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr const char* cgroupRoot = "/sys/fs/cgroup";
+
+// Rough peak memory used by a transcoding job (decoders, queues, encoders
+// lookahead buffers), used to bound the default number of parallel jobs.
+constexpr std::uint64_t memoryPerJob = 512ULL * 1024 * 1024;
+
+std::vector<std::string> readFields(const std::string& path)
+{
+    std::vector<std::string> fields;
+    std::ifstream in(path);
+    std::string field;
+    while (in >> field)
+    {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+// Returns the cgroup path of the process for the given v1 controller, or
+// the unified v2 hierarchy path when controller is empty.
+std::string getCgroupPath(const std::string& controller)
+{
+    std::ifstream in("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(in, line))
+    {
+        // hierarchy-ID:controller-list:cgroup-path
+        const auto first = line.find(':');
+        const auto second = line.find(':', first + 1);
+        if ((first == std::string::npos) || (second == std::string::npos))
+        {
+            continue;
+        }
+
+        const auto controllers = line.substr(first + 1, second - first - 1);
+        if (controller.empty() ? controllers.empty()
+                               : (("," + controllers + ",").find("," + controller + ",") != std::string::npos))
+        {
+            return line.substr(second + 1);
+        }
+    }
+
+    return std::string();
+}
+
+// Lists the given cgroup directory and its parents, as the most restrictive
+// limit may be set on any of them. Inside a container the cgroup namespace
+// root is mounted directly, which is covered by the mount point itself.
+std::vector<std::string> getCgroupDirs(const std::string& mountPoint, std::string path)
+{
+    std::vector<std::string> dirs;
+    while (!path.empty() && (path != "/"))
+    {
+        dirs.push_back(mountPoint + path);
+        path = path.substr(0, path.find_last_of('/'));
+    }
+    dirs.push_back(mountPoint);
+    return dirs;
+}
+
+double readCpuQuota()
+{
+    double quota = std::numeric_limits<double>::infinity();
+
+    // cgroup v2: cpu.max contains "$MAX $PERIOD" with "max" when unlimited.
+    for (const auto& dir : getCgroupDirs(cgroupRoot, getCgroupPath(std::string())))
+    {
+        const auto fields = readFields(dir + "/cpu.max");
+        if ((fields.size() == 2) && (fields[0] != "max") && (std::stod(fields[1]) > 0))
+        {
+            quota = std::min(quota, std::stod(fields[0]) / std::stod(fields[1]));
+        }
+    }
+
+    // cgroup v1: cfs quota is -1 when unlimited.
+    for (const char* mount : {"/cpu", "/cpu,cpuacct", "/cpuacct,cpu"})
+    {
+        for (const auto& dir : getCgroupDirs(std::string(cgroupRoot) + mount, getCgroupPath("cpu")))
+        {
+            const auto max = readFields(dir + "/cpu.cfs_quota_us");
+            const auto period = readFields(dir + "/cpu.cfs_period_us");
+            if (!max.empty() && !period.empty() && (std::stod(max[0]) > 0) && (std::stod(period[0]) > 0))
+            {
+                quota = std::min(quota, std::stod(max[0]) / std::stod(period[0]));
+            }
+        }
+    }
+
+    return quota;
+}
+
+std::uint64_t readAvailableMemory()
+{
+    std::uint64_t available = 0;
+
+    std::ifstream in("/proc/meminfo");
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string name;
+        std::uint64_t kiB = 0;
+        if ((fields >> name >> kiB) && (name == "MemAvailable:"))
+        {
+            available = kiB * 1024;
+            break;
+        }
+    }
+
+    // The cgroup memory limit, minus what is already used, when smaller.
+    const auto applyLimit = [&available](const std::string& limitFile, const std::string& usageFile) {
+        const auto limit = readFields(limitFile);
+        const auto usage = readFields(usageFile);
+        if (!limit.empty() && (limit[0] != "max") && !usage.empty())
+        {
+            const std::uint64_t maximum = std::stoull(limit[0]);
+            const std::uint64_t used = std::stoull(usage[0]);
+            const std::uint64_t remaining = (maximum > used) ? maximum - used : 0;
+            available = (available != 0) ? std::min(available, remaining) : remaining;
+        }
+    };
+
+    for (const auto& dir : getCgroupDirs(cgroupRoot, getCgroupPath(std::string())))
+    {
+        applyLimit(dir + "/memory.max", dir + "/memory.current");
+    }
+    for (const auto& dir : getCgroupDirs(std::string(cgroupRoot) + "/memory", getCgroupPath("memory")))
+    {
+        applyLimit(dir + "/memory.limit_in_bytes", dir + "/memory.usage_in_bytes");
+    }
+
+    return available;
+}
+} // namespace
+
+const ResourceDiscovery& ResourceDiscovery::getInstance()
+{
+    static const ResourceDiscovery instance;
+    return instance;
+}
+
+ResourceDiscovery::ResourceDiscovery()
+    : m_hardwareCpuCount(std::max(std::thread::hardware_concurrency(), 1U)), m_affinityCpuCount(m_hardwareCpuCount),
+      m_cpuQuota(std::numeric_limits<double>::infinity()), m_cpuCount(m_hardwareCpuCount), m_availableMemory(0)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+    {
+        m_affinityCpuCount = std::max(static_cast<unsigned int>(CPU_COUNT(&cpus)), 1U); // NOLINT
+    }
+
+    // Unreadable or malformed cgroup files just mean there is no limit.
+    try
+    {
+        m_cpuQuota = readCpuQuota();
+    }
+    catch (const std::exception& e)
+    {
+        m_cpuQuota = std::numeric_limits<double>::infinity();
+    }
+
+    try
+    {
+        m_availableMemory = readAvailableMemory();
+    }
+    catch (const std::exception& e)
+    {
+        m_availableMemory = 0;
+    }
+
+    m_cpuCount = m_affinityCpuCount;
+    if (std::isfinite(m_cpuQuota))
+    {
+        m_cpuCount = std::clamp(static_cast<unsigned int>(std::ceil(m_cpuQuota)), 1U, m_cpuCount);
+    }
+}
+
+unsigned int ResourceDiscovery::getDefaultJobCount() const noexcept
+{
+    if (m_availableMemory == 0)
+    {
+        return m_cpuCount;
+    }
+
+    const auto memoryJobs = static_cast<unsigned int>(
+        std::min<std::uint64_t>(m_availableMemory / memoryPerJob, std::numeric_limits<unsigned int>::max()));
+    return std::clamp(memoryJobs, 1U, m_cpuCount);
+}
+
+unsigned int ResourceDiscovery::getThreadsPerJob(unsigned int jobs) const noexcept
+{
+    return std::max(m_cpuCount / std::max(jobs, 1U), 1U);
+}
+
+void ResourceDiscovery::printSummary() const
+{
+    std::cout << "Available CPUs: " << m_cpuCount << " (" << m_hardwareCpuCount << " online, " << m_affinityCpuCount
+              << " in affinity mask";
+    if (std::isfinite(m_cpuQuota))
+    {
+        std::cout << ", cgroup quota " << m_cpuQuota;
+    }
+    std::cout << ")" << std::endl;
+
+    if (m_availableMemory != 0)
+    {
+        std::cout << "Available memory: " << m_availableMemory / (1024 * 1024) << " MiB" << std::endl;
+    }
+}
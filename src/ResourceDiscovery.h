@@ -0,0 +1,60 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+class ResourceDiscovery final
+{
+  public:
+    static const ResourceDiscovery& getInstance();
+    ~ResourceDiscovery() = default;
+
+    ResourceDiscovery(const ResourceDiscovery&) = delete;
+    ResourceDiscovery& operator=(const ResourceDiscovery&) = delete;
+    ResourceDiscovery(ResourceDiscovery&&) = delete;
+    ResourceDiscovery& operator=(ResourceDiscovery&&) = delete;
+
+    // CPUs actually usable by the process, taking the CPU affinity and the
+    // cgroup CPU quota into account.
+    unsigned int getCpuCount() const noexcept
+    {
+        return m_cpuCount;
+    }
+
+    // Bytes, 0 if unknown.
+    std::uint64_t getAvailableMemory() const noexcept
+    {
+        return m_availableMemory;
+    }
+
+    unsigned int getDefaultJobCount() const noexcept;
+    unsigned int getThreadsPerJob(unsigned int jobs) const noexcept;
+
+    void printSummary() const;
+
+  private:
+    ResourceDiscovery();
+
+    unsigned int m_hardwareCpuCount;
+    unsigned int m_affinityCpuCount;
+    double m_cpuQuota;
+    unsigned int m_cpuCount;
+    std::uint64_t m_availableMemory;
+};
@@ -0,0 +1,88 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SourceProbe.h"
+#include "exceptions.h"
+#include <sys/stat.h>
+
+namespace
+{
+constexpr Gst::ClockTime probeTimeout = 10 * GST_SECOND;
+
+// Modification time and size of a local file, empty for other URIs.
+std::string getFileStamp(const Glib::ustring& uri)
+{
+    if (Glib::uri_parse_scheme(uri) != "file")
+    {
+        return std::string();
+    }
+
+    struct stat info = {};
+    if (stat(Glib::filename_from_uri(uri).c_str(), &info) != 0)
+    {
+        return std::string();
+    }
+
+    return std::to_string(info.st_mtim.tv_sec) + "." + std::to_string(info.st_mtim.tv_nsec) + ":" +
+           std::to_string(info.st_size);
+}
+} // namespace
+
+SourceProbe& SourceProbe::getInstance()
+{
+    static SourceProbe instance;
+    return instance;
+}
+
+SourceProbe::SourceProbe() : m_hitCount(0)
+{
+    // Empty constructor.
+}
+
+std::shared_ptr<const SourceInfo> SourceProbe::probe(const Glib::ustring& uri)
+{
+    const auto fileStamp = getFileStamp(uri);
+    auto it = m_entries.find(uri);
+    if ((it != m_entries.end()) && !fileStamp.empty() && (it->second.fileStamp == fileStamp))
+    {
+        ++m_hitCount;
+        return it->second.info;
+    }
+
+    if (!m_discoverer)
+    {
+        m_discoverer = Gst::Discoverer::create(probeTimeout);
+    }
+
+    auto discovered = m_discoverer ? m_discoverer->discover_uri(uri) : Glib::RefPtr<Gst::DiscovererInfo>();
+    if (!discovered)
+    {
+        throw CannotProbeSourceException();
+    }
+
+    auto info = std::make_shared<SourceInfo>();
+    info->duration = static_cast<gint64>(discovered->get_duration());
+    info->isSeekable = discovered->get_seekable();
+
+    // Remote sources are not cached, they can't be checked for changes.
+    if (!fileStamp.empty())
+    {
+        m_entries[uri] = Entry{fileStamp, info};
+    }
+    return info;
+}
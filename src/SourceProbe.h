@@ -0,0 +1,65 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gstreamermm.h>
+#include <map>
+#include <memory>
+#include <string>
+
+// Discoverer metadata of a source media.
+struct SourceInfo
+{
+    gint64 duration = 0;
+    bool isSeekable = false;
+};
+
+// Probes are cached by URI, local files being probed again only when their
+// modification time or size has changed.
+class SourceProbe final
+{
+  public:
+    static SourceProbe& getInstance();
+    ~SourceProbe() = default;
+
+    SourceProbe(const SourceProbe&) = delete;
+    SourceProbe& operator=(const SourceProbe&) = delete;
+    SourceProbe(SourceProbe&&) = delete;
+    SourceProbe& operator=(SourceProbe&&) = delete;
+
+    std::shared_ptr<const SourceInfo> probe(const Glib::ustring& uri);
+
+    unsigned int getHitCount() const noexcept
+    {
+        return m_hitCount;
+    }
+
+  private:
+    SourceProbe();
+
+    struct Entry
+    {
+        std::string fileStamp;
+        std::shared_ptr<const SourceInfo> info;
+    };
+
+    Glib::RefPtr<Gst::Discoverer> m_discoverer;
+    std::map<Glib::ustring, Entry> m_entries;
+    unsigned int m_hitCount;
+};
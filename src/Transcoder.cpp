@@ -17,24 +17,41 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "Transcoder.h"
+#include "codecs/MultithreadedCodec.h"
 #include "exceptions.h"
+#include "io/FileReader.h"
+#include <algorithm>
 #include <iostream>
 
+NLOHMANN_JSON_SERIALIZE_ENUM(Player::SeekMode, // NOLINT
+                             {{Player::SeekMode::accurate, "accurate"}, {Player::SeekMode::keyframe, "keyframe"}});
+
 namespace
 {
-constexpr const char* encodersKey = "encoders";
+const std::shared_ptr<Codec>& getCodec(const Encoder& encoder, GstStreamType streamType) noexcept
+{
+    return (streamType == GST_STREAM_TYPE_VIDEO) ? encoder.getVideoCodec() : encoder.getAudioCodec();
+}
 } // namespace
 
 std::shared_ptr<Transcoder> Transcoder::create(int argc, char** argv, bool forceSoftwareEncoding)
 {
     Gst::init(argc, argv);
+    FileReader::registerSource();
     Codec::forceSoftwareEncoding(forceSoftwareEncoding);
     std::shared_ptr<Transcoder> transcoder(new Transcoder());
-    transcoder->m_player.addPlayerListener(transcoder);
+    for (auto& player : transcoder->m_players)
+    {
+        player.addPlayerListener(transcoder);
+    }
     return transcoder;
 }
 
 Transcoder::Transcoder()
+    : m_activePlayer(0), m_isLookaheadEnabled(false), m_isStageDumpEnabled(false),
+      m_threadLimit(Codec::defaultValue), m_startTime(Player::undefinedTime), m_endTime(Player::undefinedTime),
+      m_seekMode(Player::SeekMode::accurate), m_configStartTime(Player::undefinedTime),
+      m_configEndTime(Player::undefinedTime), m_configSeekMode(Player::SeekMode::accurate)
 {
     m_mainLoop = Glib::MainLoop::create();
 
@@ -46,62 +63,274 @@ Transcoder::Transcoder()
 
 void Transcoder::addEncoder(const std::shared_ptr<Encoder>& encoder)
 {
-    if (!m_player.hasStableState(Player::State::stopped))
+    if (!getActivePlayer().hasStableState(Player::State::stopped))
     {
         throw InvalidStateException();
     }
 
     if (encoder && (std::find(m_encoders.begin(), m_encoders.end(), encoder) == m_encoders.end()))
     {
-        m_player.addPlayerListener(encoder);
+        releasePipeline();
+        for (auto& player : m_players)
+        {
+            player.addPlayerListener(encoder);
+        }
         m_encoders.push_back(encoder);
+        shareCodecStages();
+        applyThreadLimit();
     }
 }
 
 void Transcoder::clearEncoders()
 {
-    if (!m_player.hasStableState(Player::State::stopped))
+    if (!getActivePlayer().hasStableState(Player::State::stopped))
     {
         throw InvalidStateException();
     }
 
+    releasePipeline();
     for (auto& encoder : m_encoders)
     {
-        m_player.removePlayerListener(encoder);
+        for (auto& player : m_players)
+        {
+            player.removePlayerListener(encoder);
+        }
     }
 
     m_encoders.clear();
 }
 
-void Transcoder::transcode(const Glib::ustring& uri)
+void Transcoder::setPipelineRecycling(bool isEnabled)
+{
+    if (!isStopped())
+    {
+        throw InvalidStateException();
+    }
+
+    for (auto& player : m_players)
+    {
+        player.setRecycling(isEnabled);
+    }
+
+    if (!isEnabled)
+    {
+        releasePipeline();
+    }
+}
+
+void Transcoder::setThreadLimit(int n) noexcept
+{
+    m_threadLimit = (n > 0) ? n : Codec::defaultValue;
+    for (auto& player : m_players)
+    {
+        player.setDecoderThreadLimit(std::max(n, 0));
+    }
+    applyThreadLimit();
+}
+
+void Transcoder::setStageDump(bool isEnabled) noexcept
+{
+    m_isStageDumpEnabled = isEnabled;
+}
+
+void Transcoder::setLookahead(bool isEnabled)
+{
+    m_isLookaheadEnabled = isEnabled;
+    if (!isEnabled)
+    {
+        cancelPreparation();
+    }
+}
+
+void Transcoder::parsePlaybackRange(const Json& in, gint64& startTime, gint64& endTime, Player::SeekMode& seekMode)
+{
+    startTime = Player::undefinedTime;
+    endTime = Player::undefinedTime;
+    seekMode = Player::SeekMode::accurate;
+    if (in.contains(startKey))
+    {
+        startTime = static_cast<gint64>(in.at(startKey).get<double>() * GST_SECOND);
+    }
+    if (in.contains(endKey))
+    {
+        endTime = static_cast<gint64>(in.at(endKey).get<double>() * GST_SECOND);
+    }
+    if (in.contains(seekModeKey))
+    {
+        seekMode = in.at(seekModeKey).get<Player::SeekMode>();
+    }
+
+    startTime = (startTime > 0) ? startTime : Player::undefinedTime;
+    endTime = (endTime > 0) ? endTime : Player::undefinedTime;
+    if ((startTime != Player::undefinedTime) && (endTime != Player::undefinedTime) && (endTime <= startTime))
+    {
+        throw InvalidValueException();
+    }
+}
+
+bool Transcoder::prepare(const Glib::ustring& uri, gint64 startTime, gint64 endTime, Player::SeekMode seekMode)
+{
+    auto& player = getLookaheadPlayer();
+    if (!m_isLookaheadEnabled || m_encoders.empty() || !player.hasStableState(Player::State::stopped))
+    {
+        return false;
+    }
+
+    // The lookahead player prerolls the next source while the active one is
+    // still transcoding, but it is held before encoders get connected to it.
+    player.setPlaybackRange(startTime, endTime, seekMode);
+    player.setPassthroughCaps(getPassthroughCaps());
+    player.setStreamTypes(getStreamTypes());
+    player.setTrackSelections(getTrackSelections(GST_STREAM_TYPE_VIDEO), getTrackSelections(GST_STREAM_TYPE_AUDIO));
+    player.preroll(uri);
+    return true;
+}
+
+void Transcoder::cancelPreparation() noexcept
+{
+    auto& player = getLookaheadPlayer();
+    if (!player.hasStableState(Player::State::stopped))
+    {
+        player.stop();
+    }
+}
+
+void Transcoder::addTranscoderListener(const std::shared_ptr<ITranscoderListener>& listener) noexcept
+{
+    if (listener)
+    {
+        for (auto it = m_listeners.begin(); it != m_listeners.end();)
+        {
+            auto entry = it->lock();
+            if (entry)
+            {
+                if (entry == listener)
+                {
+                    return;
+                }
+                ++it;
+            }
+            else
+            {
+                it = m_listeners.erase(it);
+            }
+        }
+
+        m_listeners.push_back(listener);
+    }
+}
+
+void Transcoder::removeTranscoderListener(const std::shared_ptr<ITranscoderListener>& listener) noexcept
+{
+    if (listener)
+    {
+        for (auto it = m_listeners.begin(); it != m_listeners.end();)
+        {
+            auto entry = it->lock();
+            if (entry)
+            {
+                if (entry == listener)
+                {
+                    m_listeners.erase(it);
+                    return;
+                }
+                ++it;
+            }
+            else
+            {
+                it = m_listeners.erase(it);
+            }
+        }
+    }
+}
+
+void Transcoder::setPlaybackRange(gint64 startTime, gint64 endTime, Player::SeekMode seekMode)
+{
+    if (!getActivePlayer().hasStableState(Player::State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    m_startTime = (startTime > 0) ? startTime : Player::undefinedTime;
+    m_endTime = (endTime > 0) ? endTime : Player::undefinedTime;
+    m_seekMode = seekMode;
+}
+
+void Transcoder::start(const Glib::ustring& uri)
 {
     if (m_encoders.empty())
     {
         throw NoEncoderException();
     }
 
-    m_player.play(uri);
+    if (!getActivePlayer().hasStableState(Player::State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    // If the lookahead player has already prerolled this source, it just
+    // becomes the active one and is resumed.
+    auto& lookaheadPlayer = getLookaheadPlayer();
+    if (lookaheadPlayer.isHeld())
+    {
+        if ((lookaheadPlayer.getUri() == uri) && (lookaheadPlayer.getStartTime() == m_startTime) &&
+            (lookaheadPlayer.getEndTime() == m_endTime) && (lookaheadPlayer.getSeekMode() == m_seekMode))
+        {
+            m_activePlayer = 1 - m_activePlayer;
+            m_sourceUri = uri;
+            lookaheadPlayer.resume();
+            return;
+        }
+
+        lookaheadPlayer.stop();
+    }
+
+    auto& player = getActivePlayer();
+    player.setPlaybackRange(m_startTime, m_endTime, m_seekMode);
+    player.setPassthroughCaps(getPassthroughCaps());
+    player.setStreamTypes(getStreamTypes());
+    player.setTrackSelections(getTrackSelections(GST_STREAM_TYPE_VIDEO), getTrackSelections(GST_STREAM_TYPE_AUDIO));
+    player.play(uri);
+    m_sourceUri = uri;
+}
+
+void Transcoder::transcode(const Glib::ustring& uri)
+{
+    start(uri);
     m_mainLoop->run();
 }
 
 void Transcoder::interruptTranscoding() noexcept
 {
     std::cout << "Interrupting transcoding..." << std::endl;
-    m_player.stop();
+    cancelPreparation();
+    getActivePlayer().stop();
+}
+
+bool Transcoder::isTranscoding() const noexcept
+{
+    return !getActivePlayer().hasStableState(Player::State::stopped);
 }
 
 float Transcoder::getProgress() const noexcept
 {
-    if (m_player.hasStableState(Player::State::playing))
+    const auto& player = getActivePlayer();
+    if (player.hasStableState(Player::State::playing))
     {
-        const auto& pipeline = m_player.getPipeline();
+        const auto& pipeline = player.getPipeline();
         gint64 duration = 0;
         if (pipeline->query_duration(Gst::FORMAT_TIME, duration) && (duration > 0))
         {
+            const gint64 startTime = std::max<gint64>(player.getStartTime(), 0);
+            const gint64 endTime = (player.getEndTime() != Player::undefinedTime)
+                                       ? std::min(player.getEndTime(), duration)
+                                       : duration;
+
             gint64 position = 0;
-            if (pipeline->query_position(Gst::FORMAT_TIME, position) && (position > 0))
+            if ((endTime > startTime) && pipeline->query_position(Gst::FORMAT_TIME, position) &&
+                (position > startTime))
             {
-                return static_cast<float>(position) / duration;
+                return static_cast<float>(position - startTime) / (endTime - startTime);
             }
         }
     }
@@ -114,28 +343,53 @@ void Transcoder::onPlayerPrerolled(Player& /*player*/)
     std::cout << "Configuring transcoder..." << std::endl;
 }
 
-void Transcoder::onPlayerPlaying(Player& /*player*/) noexcept
+void Transcoder::onPlayerPlaying(Player& player) noexcept
 {
+    if (m_isStageDumpEnabled)
+    {
+        std::cout << "Source streams and outputs of " << player.getUri() << ":" << std::endl;
+        player.dumpConnectors(std::cout);
+    }
+
     std::cout << "Transcoding..." << std::endl;
 }
 
-void Transcoder::onPlayerStopped(Player& /*player*/, bool isInterrupted) noexcept
+void Transcoder::onPlayerStopped(Player& player, bool isInterrupted) noexcept
 {
+    // Lookahead player being cancelled.
+    if (&player != &getActivePlayer())
+    {
+        return;
+    }
+
     if (isInterrupted)
     {
-        std::cout << "Transcoding interrupted before end." << std::endl;
+        std::cout << "Transcoding interrupted before end: " << m_sourceUri << std::endl;
     }
     else
     {
-        std::cout << "Transcoding finished." << std::endl;
+        std::cout << "Transcoding finished: " << m_sourceUri << std::endl;
     }
 
-    m_mainLoop->quit();
+    // When driven by a TranscoderPool, the main loop run is owned by the pool
+    // and the blocking transcode() method is not used.
+    if (m_mainLoop->is_running())
+    {
+        m_mainLoop->quit();
+    }
+
+    triggerTranscodingFinished(!isInterrupted);
 }
 
-void Transcoder::onPipelineIssue(Player& /*player*/, bool isFatalError, const Glib::Error& error,
+void Transcoder::onPipelineIssue(Player& player, bool isFatalError, const Glib::Error& error,
                                  const std::string& debugMessage) noexcept
 {
+    if (&player != &getActivePlayer())
+    {
+        std::cerr << "Cannot preroll next source " << player.getUri() << ": " << error.what() << std::endl;
+        return;
+    }
+
     std::cerr << "Transcoding issue: " << error.what() << " (Debug info: " << debugMessage << ")" << std::endl;
     if (isFatalError)
     {
@@ -154,6 +408,22 @@ Json Transcoder::serialize() const
     Json obj = Json::object();
     obj[ISerializable::typeKey] = Transcoder::type;
     obj[encodersKey] = std::move(encoders);
+
+    if (m_configStartTime != Player::undefinedTime)
+    {
+        obj[startKey] = static_cast<double>(m_configStartTime) / GST_SECOND;
+    }
+
+    if (m_configEndTime != Player::undefinedTime)
+    {
+        obj[endKey] = static_cast<double>(m_configEndTime) / GST_SECOND;
+    }
+
+    if (m_configSeekMode != Player::SeekMode::accurate)
+    {
+        obj[seekModeKey] = m_configSeekMode;
+    }
+
     return obj;
 }
 
@@ -164,6 +434,10 @@ void Transcoder::unserialize(const Json& in)
         throw InvalidTypeException();
     }
 
+    // The range is applied by whoever schedules the jobs (see TranscoderPool),
+    // which may split it into segments.
+    parsePlaybackRange(in, m_configStartTime, m_configEndTime, m_configSeekMode);
+
     clearEncoders();
     for (const auto& entry : in.at(encodersKey))
     {
@@ -172,3 +446,170 @@ void Transcoder::unserialize(const Json& in)
         addEncoder(encoder);
     }
 }
+
+bool Transcoder::isStopped() const noexcept
+{
+    return std::all_of(m_players.begin(), m_players.end(),
+                       [](const Player& player) { return player.hasStableState(Player::State::stopped); });
+}
+
+void Transcoder::releasePipeline()
+{
+    // Encoders elements kept from a recycled pipeline are only connected to
+    // the current encoders set, so they can't be reused once it changes.
+    cancelPreparation();
+    for (auto& player : m_players)
+    {
+        player.releaseConnectors();
+    }
+    for (auto& encoder : m_encoders)
+    {
+        encoder->cleanupEncoder();
+    }
+}
+
+void Transcoder::shareCodecStages()
+{
+    // Encoders with identical codec settings, raw caps and selected tracks for
+    // a type of stream share the same codec stage, so that the stream is
+    // encoded once.
+    for (const auto streamType : {GST_STREAM_TYPE_VIDEO, GST_STREAM_TYPE_AUDIO})
+    {
+        for (auto& encoder : m_encoders)
+        {
+            encoder->setCodecStage(streamType, nullptr);
+        }
+
+        for (size_t i = 0; i < m_encoders.size(); ++i)
+        {
+            const auto& codec = getCodec(*m_encoders[i], streamType);
+            if (!codec || m_encoders[i]->getCodecStage(streamType))
+            {
+                continue;
+            }
+
+            const auto config = codec->serialize();
+            const auto caps = m_encoders[i]->getRestrictionCaps(streamType);
+            std::shared_ptr<CodecStage> stage;
+            for (size_t j = i + 1; j < m_encoders.size(); ++j)
+            {
+                const auto& other = getCodec(*m_encoders[j], streamType);
+                if (other && !m_encoders[j]->getCodecStage(streamType) && (other->serialize() == config) &&
+                    m_encoders[j]->getRestrictionCaps(streamType)->is_equal(caps) &&
+                    (m_encoders[j]->getTrackSelection(streamType) == m_encoders[i]->getTrackSelection(streamType)))
+                {
+                    if (!stage)
+                    {
+                        stage = std::make_shared<CodecStage>(codec, caps, streamType);
+                        m_encoders[i]->setCodecStage(streamType, stage);
+                    }
+                    m_encoders[j]->setCodecStage(streamType, stage);
+                }
+            }
+        }
+    }
+}
+
+void Transcoder::applyThreadLimit() const noexcept
+{
+    // The limit is shared between all the video encoders of the job, it is
+    // applied when codecs are configured at the next preroll. Encoders
+    // sharing a codec stage only run the codec of the stage.
+    std::vector<std::shared_ptr<MultithreadedCodec>> codecs;
+    for (const auto& encoder : m_encoders)
+    {
+        const auto& stage = encoder->getCodecStage(GST_STREAM_TYPE_VIDEO);
+        auto codec = std::dynamic_pointer_cast<MultithreadedCodec>(encoder->getVideoCodec());
+        if (codec && (!stage || (stage->getCodec() == encoder->getVideoCodec())))
+        {
+            codecs.push_back(codec);
+        }
+    }
+
+    for (auto& codec : codecs)
+    {
+        codec->setThreadLimit((m_threadLimit != Codec::defaultValue)
+                                  ? std::max(m_threadLimit / static_cast<int>(codecs.size()), 1)
+                                  : Codec::defaultValue);
+    }
+}
+
+Glib::RefPtr<Gst::Caps> Transcoder::getPassthroughCaps() const
+{
+    // A stream can't be both copied and decoded, so it is only copied when
+    // every encoder using that type of stream accepts it as is.
+    auto caps = Gst::Caps::create_empty();
+    for (const auto streamType : {GST_STREAM_TYPE_VIDEO, GST_STREAM_TYPE_AUDIO})
+    {
+        Glib::RefPtr<Gst::Caps> accepted;
+        for (const auto& encoder : m_encoders)
+        {
+            if (getCodec(*encoder, streamType))
+            {
+                auto encoderCaps = encoder->getPassthroughCaps(streamType);
+                if (!encoderCaps)
+                {
+                    accepted = Gst::Caps::create_empty();
+                    break;
+                }
+
+                accepted = accepted ? accepted->get_intersect(encoderCaps) : encoderCaps;
+            }
+        }
+
+        if (accepted)
+        {
+            caps = caps->merge(accepted);
+        }
+    }
+
+    return caps->empty() ? Glib::RefPtr<Gst::Caps>() : caps;
+}
+
+GstStreamType Transcoder::getStreamTypes() const noexcept
+{
+    int streamTypes = GST_STREAM_TYPE_UNKNOWN;
+    for (const auto& encoder : m_encoders)
+    {
+        for (const auto streamType : {GST_STREAM_TYPE_VIDEO, GST_STREAM_TYPE_AUDIO})
+        {
+            if (getCodec(*encoder, streamType))
+            {
+                streamTypes |= streamType;
+            }
+        }
+    }
+
+    return static_cast<GstStreamType>(streamTypes);
+}
+
+std::vector<TrackSelection> Transcoder::getTrackSelections(GstStreamType streamType) const
+{
+    std::vector<TrackSelection> selections;
+    for (const auto& encoder : m_encoders)
+    {
+        if (getCodec(*encoder, streamType))
+        {
+            selections.push_back(encoder->getTrackSelection(streamType));
+        }
+    }
+
+    return selections;
+}
+
+void Transcoder::triggerTranscodingFinished(bool isSuccess) noexcept
+{
+    for (auto it = m_listeners.begin(); it != m_listeners.end();)
+    {
+        auto listener = it->lock();
+        if (listener)
+        {
+            listener->onTranscodingFinished(*this, m_sourceUri, isSuccess);
+            ++it;
+        }
+        else
+        {
+            it = m_listeners.erase(it);
+        }
+    }
+}
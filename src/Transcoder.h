@@ -18,13 +18,23 @@
  */
 #pragma once
 
+#include "ITranscoderListener.h"
 #include "encoders/Encoder.h"
+#include <algorithm>
+#include <array>
 #include <glibmm/main.h>
 
 class Transcoder final : public IPlayerListener, public ISerializable
 {
   public:
     static constexpr const char* type = "transcoder";
+    static constexpr const char* encodersKey = "encoders";
+    static constexpr const char* startKey = "start";
+    static constexpr const char* endKey = "end";
+    static constexpr const char* seekModeKey = "seek";
+
+    // Playback range of a configuration, times in ns.
+    static void parsePlaybackRange(const Json& in, gint64& startTime, gint64& endTime, Player::SeekMode& seekMode);
 
     static std::shared_ptr<Transcoder> create(int argc, char** argv, bool forceSoftwareEncoding = false);
     ~Transcoder() final = default;
@@ -41,10 +51,41 @@ class Transcoder final : public IPlayerListener, public ISerializable
         return m_encoders;
     }
 
+    void addTranscoderListener(const std::shared_ptr<ITranscoderListener>& listener) noexcept;
+    void removeTranscoderListener(const std::shared_ptr<ITranscoderListener>& listener) noexcept;
+
+    void setPipelineRecycling(bool isEnabled);
+    unsigned int getRecycleCount() const noexcept
+    {
+        return m_players[0].getRecycleCount() + m_players[1].getRecycleCount();
+    }
+
+    void setThreadLimit(int n = Codec::defaultValue) noexcept;
+    int getPeakThreadCount() const noexcept
+    {
+        return std::max(m_players[0].getPeakThreadCount(), m_players[1].getPeakThreadCount());
+    }
+
+    void setStageDump(bool isEnabled) noexcept;
+    void setLookahead(bool isEnabled);
+    bool prepare(const Glib::ustring& uri, gint64 startTime = Player::undefinedTime,
+                 gint64 endTime = Player::undefinedTime, Player::SeekMode seekMode = Player::SeekMode::accurate);
+    void cancelPreparation() noexcept;
+
+    void setPlaybackRange(gint64 startTime = Player::undefinedTime, gint64 endTime = Player::undefinedTime,
+                          Player::SeekMode seekMode = Player::SeekMode::accurate);
+
+    void start(const Glib::ustring& uri);
     void transcode(const Glib::ustring& uri);
     void interruptTranscoding() noexcept;
+    bool isTranscoding() const noexcept;
     float getProgress() const noexcept;
 
+    const Glib::ustring& getSourceUri() const noexcept
+    {
+        return m_sourceUri;
+    }
+
     void onPlayerPrerolled(Player& player) final;
     void onPlayerPlaying(Player& player) noexcept final;
     void onPlayerStopped(Player& player, bool isInterrupted) noexcept final;
@@ -56,7 +97,41 @@ class Transcoder final : public IPlayerListener, public ISerializable
 
   private:
     Transcoder();
-    Player m_player;
+    std::array<Player, 2> m_players;
+    size_t m_activePlayer;
+    bool m_isLookaheadEnabled;
+    bool m_isStageDumpEnabled;
+    int m_threadLimit;
+    gint64 m_startTime;
+    gint64 m_endTime;
+    Player::SeekMode m_seekMode;
+    gint64 m_configStartTime;
+    gint64 m_configEndTime;
+    Player::SeekMode m_configSeekMode;
     Glib::RefPtr<Glib::MainLoop> m_mainLoop;
     std::vector<std::shared_ptr<Encoder>> m_encoders;
+    std::vector<std::weak_ptr<ITranscoderListener>> m_listeners;
+    Glib::ustring m_sourceUri;
+
+    Player& getActivePlayer() noexcept
+    {
+        return m_players[m_activePlayer];
+    }
+    const Player& getActivePlayer() const noexcept
+    {
+        return m_players[m_activePlayer];
+    }
+    Player& getLookaheadPlayer() noexcept
+    {
+        return m_players[1 - m_activePlayer];
+    }
+
+    bool isStopped() const noexcept;
+    void releasePipeline();
+    void shareCodecStages();
+    void applyThreadLimit() const noexcept;
+    Glib::RefPtr<Gst::Caps> getPassthroughCaps() const;
+    GstStreamType getStreamTypes() const noexcept;
+    std::vector<TrackSelection> getTrackSelections(GstStreamType streamType) const;
+    void triggerTranscodingFinished(bool isSuccess) noexcept;
 };
@@ -0,0 +1,973 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TranscoderPool.h"
+#include "ResourceDiscovery.h"
+#include "SourceProbe.h"
+#include "encoders/HlsEncoder.h"
+#include "exceptions.h"
+#include "io/FileReader.h"
+#include "io/FileWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glibmm/miscutils.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+// Streaming threads expected for a job until one has been measured.
+constexpr int defaultJobThreads = 8;
+
+std::vector<std::string> getOutputFiles(const Json& config, const std::string& dir, const Glib::ustring& uri,
+                                        const std::string& suffix = std::string())
+{
+    std::vector<std::string> files;
+    if (dir.empty())
+    {
+        for (const auto& entry : config.at(Transcoder::encodersKey))
+        {
+            files.push_back(entry.value(Encoder::outputFileKey, ""));
+        }
+
+        return files;
+    }
+
+    auto name = Glib::path_get_basename(uri);
+    name = name.substr(0, name.find_last_of('.'));
+    name = Glib::build_filename(dir, name);
+    name += suffix;
+    name += "_transcoded_";
+
+    int index = 0;
+    std::ostringstream out(std::ios_base::app);
+    for (const auto& entry : config.at(Transcoder::encodersKey))
+    {
+        out.str(name);
+        out << std::setw(2) << std::setfill('0') << index++ << '.'
+            << Encoder::getFileExtension(entry.at(ISerializable::typeKey).get<std::string>());
+        files.push_back(out.str());
+    }
+
+    return files;
+}
+
+std::string getUriSuffix(const Glib::ustring& uri)
+{
+    gchar* checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, uri.c_str(), -1);
+    std::string suffix = "_";
+    suffix.append(checksum, 8);
+    g_free(checksum);
+    return suffix;
+}
+
+// Only video is split into segments: audio encoded per segment would repeat
+// the encoder priming and padding at each join. Passthrough video can't be
+// split either, copied parts start at the key frame preceding their start
+// and would overlap.
+bool isVideoSplittable(const Json& config)
+{
+    const auto& encoders = config.at(Transcoder::encodersKey);
+    return std::all_of(encoders.begin(), encoders.end(), [](const Json& entry) {
+        return entry.contains(Encoder::videoCodecKey) &&
+               !entry.at(Encoder::videoCodecKey).value(Codec::passthroughKey, false);
+    });
+}
+
+Json getStreamConfig(const Json& config, const char* codecKey, const char* otherCodecKey)
+{
+    Json streamConfig = config;
+    auto& encoders = streamConfig.at(Transcoder::encodersKey);
+    for (auto& entry : encoders)
+    {
+        entry.erase(otherCodecKey);
+    }
+    encoders.erase(std::remove_if(encoders.begin(), encoders.end(),
+                                  [codecKey](const Json& entry) { return !entry.contains(codecKey); }),
+                   encoders.end());
+    return streamConfig;
+}
+
+gint64 probeDuration(const Glib::ustring& uri)
+{
+    auto info = SourceProbe::getInstance().probe(uri);
+    if (!info->isSeekable)
+    {
+        throw CannotProbeSourceException();
+    }
+
+    const auto duration = info->duration;
+    if (duration <= 0)
+    {
+        throw CannotProbeSourceException();
+    }
+
+    return duration;
+}
+} // namespace
+
+std::shared_ptr<TranscoderPool> TranscoderPool::create(int argc, char** argv, unsigned int jobs,
+                                                       bool forceSoftwareEncoding)
+{
+    std::shared_ptr<TranscoderPool> pool(new TranscoderPool());
+    for (unsigned int i = 0; i < std::max(jobs, 1U); ++i)
+    {
+        auto transcoder = Transcoder::create(argc, argv, forceSoftwareEncoding);
+        transcoder->addTranscoderListener(pool);
+        pool->m_transcoders.push_back(transcoder);
+    }
+    pool->m_transcoderConfigs.resize(pool->m_transcoders.size());
+    pool->m_runningJobs.resize(pool->m_transcoders.size());
+    pool->m_preparedJobs.resize(pool->m_transcoders.size());
+    pool->setThreadLimit();
+
+    return pool;
+}
+
+TranscoderPool::TranscoderPool()
+    : m_isRecyclingEnabled(false), m_isLookaheadEnabled(false), m_threadLimit(0), m_threadsPerJob(0),
+      m_jobThreadEstimate(defaultJobThreads), m_segmentCount(0), m_segmentDurationInSec(0), m_lastSourceId(0),
+      m_totalCount(0), m_doneWeight(0.F), m_interrupted(false)
+{
+    m_mainLoop = Glib::MainLoop::create();
+
+    if (!m_mainLoop)
+    {
+        throw UnrecoverableError();
+    }
+}
+
+void TranscoderPool::setOutputDirectory(const std::string& dir) noexcept
+{
+    m_outputDirectory = dir;
+}
+
+void TranscoderPool::setPipelineRecycling(bool isEnabled)
+{
+    for (auto& transcoder : m_transcoders)
+    {
+        transcoder->setPipelineRecycling(isEnabled);
+    }
+    m_isRecyclingEnabled = isEnabled;
+}
+
+void TranscoderPool::setLookahead(bool isEnabled) noexcept
+{
+    for (auto& transcoder : m_transcoders)
+    {
+        transcoder->setLookahead(isEnabled);
+    }
+    m_isLookaheadEnabled = isEnabled;
+}
+
+void TranscoderPool::setStageDump(bool isEnabled) noexcept
+{
+    for (auto& transcoder : m_transcoders)
+    {
+        transcoder->setStageDump(isEnabled);
+    }
+}
+
+void TranscoderPool::setThreadLimit(unsigned int maxThreads) noexcept
+{
+    // Decoding and encoding threads of each job get an equal share of the
+    // budget, or of the available CPUs without budget, so that concurrent
+    // jobs don't oversubscribe the CPU.
+    const auto jobs = static_cast<unsigned int>(m_transcoders.size());
+    m_threadsPerJob = (maxThreads > 0) ? std::max(maxThreads / jobs, 1U)
+                                       : ResourceDiscovery::getInstance().getThreadsPerJob(jobs);
+    for (auto& transcoder : m_transcoders)
+    {
+        transcoder->setThreadLimit(static_cast<int>(m_threadsPerJob));
+    }
+    m_threadLimit = maxThreads;
+}
+
+void TranscoderPool::setSegmentation(unsigned int segmentCount, unsigned int segmentDurationInSec) noexcept
+{
+    m_segmentCount = segmentCount;
+    m_segmentDurationInSec = segmentDurationInSec;
+}
+
+void TranscoderPool::setOutputCache(const std::string& dir, std::uint64_t maxSize)
+{
+    m_cache = dir.empty() ? nullptr : std::make_unique<OutputCache>(dir, maxSize);
+}
+
+unsigned long TranscoderPool::enqueue(const Glib::ustring& uri, const Json& config, const std::string& outputDir,
+                                      const SlotFinished& slot)
+{
+    if (config.at(ISerializable::typeKey).get<std::string>() != Transcoder::type)
+    {
+        throw InvalidTypeException();
+    }
+
+    auto source = std::make_shared<Source>();
+    source->id = ++m_lastSourceId;
+    source->uri = uri;
+    source->config = config;
+    source->outputFiles = getOutputFiles(config, outputDir, uri);
+    if (!outputDir.empty() && isAssigned(source->outputFiles))
+    {
+        // Sources with the same name in different directories are told apart
+        // by a short hash of their URI.
+        source->outputFiles = getOutputFiles(config, outputDir, uri, getUriSuffix(uri));
+    }
+    source->slotFinished = slot;
+
+    // Piped sources and outputs can only be read or written once, from start
+    // to end, and hls outputs are made of many files besides their playlist.
+    const auto& encoders = config.at(Transcoder::encodersKey);
+    source->isSinglePass =
+        static_cast<bool>(gst_uri_has_protocol(uri.c_str(), "fd")) ||
+        std::any_of(source->outputFiles.begin(), source->outputFiles.end(),
+                    [](const std::string& file) { return file == FileWriter::standardOutput; }) ||
+        std::any_of(encoders.begin(), encoders.end(), [](const Json& entry) {
+            return entry.at(ISerializable::typeKey).get<std::string>() == HlsEncoder::type;
+        });
+    lookupCache(*source);
+
+    gint64 startTime = Player::undefinedTime;
+    gint64 endTime = Player::undefinedTime;
+    Player::SeekMode seekMode = Player::SeekMode::accurate;
+    Transcoder::parsePlaybackRange(config, startTime, endTime, seekMode);
+
+    unsigned int segmentCount = 1;
+    const gint64 rangeStart = std::max<gint64>(startTime, 0);
+    gint64 duration = 0;
+    if (!source->isCached && !source->isSinglePass && ((m_segmentCount > 1) || (m_segmentDurationInSec > 0)) &&
+        isVideoSplittable(config))
+    {
+        try
+        {
+            // Only the playback range is split into segments.
+            const auto sourceDuration = probeDuration(uri);
+            duration = ((endTime != Player::undefinedTime) ? std::min(endTime, sourceDuration) : sourceDuration) -
+                       rangeStart;
+            if (duration <= 0)
+            {
+                throw CannotProbeSourceException();
+            }
+
+            segmentCount = m_segmentCount;
+            if (m_segmentDurationInSec > 0)
+            {
+                segmentCount = static_cast<unsigned int>(
+                    std::ceil(static_cast<double>(duration) / (m_segmentDurationInSec * GST_SECOND)));
+                if (m_segmentCount > 0)
+                {
+                    segmentCount = std::min(segmentCount, m_segmentCount);
+                }
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Cannot split " << uri << " into segments (" << e.what()
+                      << "), transcoding it as a whole..." << std::endl;
+        }
+    }
+
+    m_sources[source->id] = source;
+    ++m_totalCount;
+
+    if (segmentCount <= 1)
+    {
+        Job job;
+        job.source = source;
+        job.config = config;
+        job.outputFiles = source->outputFiles;
+        job.startTime = startTime;
+        job.endTime = endTime;
+        job.seekMode = seekMode;
+        source->remainingTasks = 1;
+        m_pendingJobs.push_back(std::move(job));
+        return source->id;
+    }
+
+    // Segments boundaries are exact (accurate seeks, whatever the configured
+    // seek mode), each segment encoding starting with a new key frame, so
+    // segments can be stitched back together without re-encoding the joins.
+    // Audio is encoded in one pass over the whole range, so that its
+    // timestamps stay continuous across the joins.
+    const Json videoConfig = getStreamConfig(config, Encoder::videoCodecKey, Encoder::audioCodecKey);
+    const Json audioConfig = getStreamConfig(config, Encoder::audioCodecKey, Encoder::videoCodecKey);
+    const bool hasAudio = !audioConfig.at(Transcoder::encodersKey).empty();
+    const unsigned int taskCount = hasAudio ? segmentCount + 1 : segmentCount;
+    source->partFiles.resize(source->outputFiles.size());
+    source->remainingTasks = taskCount;
+    if (hasAudio)
+    {
+        Job job;
+        job.source = source;
+        job.config = audioConfig;
+        job.startTime = startTime;
+        job.endTime = endTime;
+        job.weight = 1.F / static_cast<float>(taskCount);
+
+        const auto& entries = config.at(Transcoder::encodersKey);
+        source->audioFiles.resize(source->outputFiles.size());
+        for (size_t j = 0; j < source->outputFiles.size(); ++j)
+        {
+            if (entries[j].contains(Encoder::audioCodecKey))
+            {
+                source->audioFiles[j] = source->outputFiles[j] + ".audio";
+                job.outputFiles.push_back(source->audioFiles[j]);
+            }
+        }
+
+        m_pendingJobs.push_back(std::move(job));
+    }
+
+    for (unsigned int i = 0; i < segmentCount; ++i)
+    {
+        Job job;
+        job.source = source;
+        job.config = videoConfig;
+        job.startTime = rangeStart + duration * i / segmentCount;
+        job.endTime = (i + 1 < segmentCount) ? rangeStart + duration * (i + 1) / segmentCount : endTime;
+        job.weight = 1.F / static_cast<float>(taskCount);
+
+        std::ostringstream suffix;
+        suffix << ".part" << std::setw(3) << std::setfill('0') << i;
+        for (size_t j = 0; j < source->outputFiles.size(); ++j)
+        {
+            job.outputFiles.push_back(source->outputFiles[j] + suffix.str());
+            source->partFiles[j].push_back(job.outputFiles.back());
+        }
+
+        m_pendingJobs.push_back(std::move(job));
+    }
+
+    return source->id;
+}
+
+void TranscoderPool::dispatch() noexcept
+{
+    for (size_t i = 0; i < m_transcoders.size(); ++i)
+    {
+        if (!m_transcoders[i]->isTranscoding())
+        {
+            if (!canStartJob())
+            {
+                return;
+            }
+            startNext(i);
+        }
+    }
+}
+
+void TranscoderPool::transcode(const std::vector<Glib::ustring>& uris)
+{
+    if (getRunningCount() != 0)
+    {
+        throw InvalidStateException();
+    }
+
+    m_pendingJobs.clear();
+    m_results.clear();
+    m_totalCount = 0;
+    m_doneWeight = 0.F;
+    m_interrupted = false;
+
+    for (const auto& uri : uris)
+    {
+        try
+        {
+            enqueue(uri, m_config, m_outputDirectory);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Cannot transcode " << uri << ": " << e.what() << std::endl;
+            m_results.emplace_back(uri, false);
+            ++m_totalCount;
+        }
+    }
+
+    dispatch();
+    if (getRunningCount() != 0)
+    {
+        m_mainLoop->run();
+    }
+
+    printSummary();
+}
+
+void TranscoderPool::interruptTranscoding() noexcept
+{
+    m_interrupted = true;
+    for (size_t i = 0; i < m_transcoders.size(); ++i)
+    {
+        takePreparedJob(i);
+    }
+
+    while (!m_pendingJobs.empty())
+    {
+        auto job = std::move(m_pendingJobs.front());
+        m_pendingJobs.pop_front();
+        finishTask(job.source, false);
+    }
+
+    for (auto& transcoder : m_transcoders)
+    {
+        if (transcoder->isTranscoding())
+        {
+            transcoder->interruptTranscoding();
+        }
+    }
+
+    quitIfIdle();
+}
+
+size_t TranscoderPool::getRunningCount() const noexcept
+{
+    size_t count = m_stitchers.size();
+    for (const auto& transcoder : m_transcoders)
+    {
+        if (transcoder->isTranscoding())
+        {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+float TranscoderPool::getProgress() const noexcept
+{
+    if (m_totalCount == 0)
+    {
+        return 0.F;
+    }
+
+    float progress = m_doneWeight;
+    for (size_t i = 0; i < m_transcoders.size(); ++i)
+    {
+        if (m_transcoders[i]->isTranscoding())
+        {
+            progress += m_runningJobs[i].weight * m_transcoders[i]->getProgress();
+        }
+    }
+
+    return progress / static_cast<float>(m_totalCount);
+}
+
+float TranscoderPool::getProgress(unsigned long id) const noexcept
+{
+    auto it = m_sources.find(id);
+    if (it == m_sources.end())
+    {
+        return 0.F;
+    }
+
+    float progress = it->second->doneWeight;
+    for (size_t i = 0; i < m_transcoders.size(); ++i)
+    {
+        if ((m_runningJobs[i].source == it->second) && m_transcoders[i]->isTranscoding())
+        {
+            progress += m_runningJobs[i].weight * m_transcoders[i]->getProgress();
+        }
+    }
+
+    return progress;
+}
+
+void TranscoderPool::onTranscodingFinished(Transcoder& transcoder, const Glib::ustring& /*uri*/,
+                                           bool isSuccess) noexcept
+{
+    size_t index = 0;
+    while ((index < m_transcoders.size()) && (m_transcoders[index].get() != &transcoder))
+    {
+        ++index;
+    }
+
+    if (index >= m_runningJobs.size())
+    {
+        return;
+    }
+
+    auto job = std::move(m_runningJobs[index]);
+    m_runningJobs[index] = Job();
+    m_jobThreadEstimate = std::max(m_jobThreadEstimate, transcoder.getPeakThreadCount());
+    m_doneWeight += job.weight;
+    if (job.source)
+    {
+        job.source->doneWeight += job.weight;
+    }
+
+    // This callback is triggered while the transcoder player is still
+    // stopping, so next jobs must be started from a fresh main loop iteration.
+    auto weakPool = std::weak_ptr<TranscoderPool>(shared_from_this());
+    Glib::signal_idle().connect_once([weakPool, source = std::move(job.source), isSuccess]() {
+        auto pool = weakPool.lock();
+        if (pool)
+        {
+            pool->finishTask(source, isSuccess);
+            pool->dispatch();
+            pool->quitIfIdle();
+        }
+    });
+}
+
+Json TranscoderPool::serialize() const
+{
+    return m_config;
+}
+
+void TranscoderPool::unserialize(const Json& in)
+{
+    for (auto& transcoder : m_transcoders)
+    {
+        transcoder->unserialize(in);
+    }
+
+    // Jobs configurations are compared against the serialized form to detect
+    // transcoders which must be reconfigured before starting a job.
+    m_config = m_transcoders.front()->serialize();
+    std::fill(m_transcoderConfigs.begin(), m_transcoderConfigs.end(), m_config);
+}
+
+bool TranscoderPool::isAssigned(const std::vector<std::string>& files) const noexcept
+{
+    for (const auto& entry : m_sources)
+    {
+        for (const auto& file : entry.second->outputFiles)
+        {
+            if (!file.empty() && (std::find(files.begin(), files.end(), file) != files.end()))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool TranscoderPool::isWritingTo(const std::vector<std::string>& files) const noexcept
+{
+    for (size_t i = 0; i < m_transcoders.size(); ++i)
+    {
+        if (m_transcoders[i]->isTranscoding())
+        {
+            for (const auto& file : m_runningJobs[i].outputFiles)
+            {
+                if (!file.empty() && (std::find(files.begin(), files.end(), file) != files.end()))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+void TranscoderPool::lookupCache(Source& source) noexcept
+{
+    if (!m_cache || source.isSinglePass || source.outputFiles.empty() ||
+        std::any_of(source.outputFiles.begin(), source.outputFiles.end(),
+                    [](const std::string& file) { return file.empty(); }))
+    {
+        return;
+    }
+
+    try
+    {
+        const auto sourceHash = m_cache->hashSource(source.uri);
+        if (sourceHash.empty())
+        {
+            return;
+        }
+
+        // An output also depends on the other encoders of the job (shared
+        // passthrough decisions) and on global settings, but not on where the
+        // outputs are written.
+        Json config = source.config;
+        for (auto& entry : config.at(Transcoder::encodersKey))
+        {
+            entry.erase(Encoder::outputFileKey);
+        }
+
+        for (size_t i = 0; i < source.outputFiles.size(); ++i)
+        {
+            Json settings = {{"transcoder", config}, {"output", i}, {"cascade", Connector::getMaxCascadeRatio()}};
+            source.cacheKeys.push_back(m_cache->getKey(sourceHash, settings));
+        }
+
+        source.isCached = std::all_of(source.cacheKeys.begin(), source.cacheKeys.end(),
+                                      [this](const std::string& key) { return m_cache->contains(key); });
+        if (!source.isCached)
+        {
+            m_cache->countMiss();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Cannot look " << source.uri << " up in output cache: " << e.what() << std::endl;
+        source.cacheKeys.clear();
+    }
+}
+
+bool TranscoderPool::fetchCachedOutputs(const Source& source) noexcept
+{
+    // Entries may have been evicted since the job has been enqueued.
+    for (size_t i = 0; i < source.cacheKeys.size(); ++i)
+    {
+        if (!m_cache->fetch(source.cacheKeys[i], source.outputFiles[i]))
+        {
+            m_cache->countMiss();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TranscoderPool::canStartJob() const noexcept
+{
+    // Streaming threads can't be capped at the task pool level, a task
+    // waiting for a thread would stall its whole pipeline. New jobs are held
+    // back instead, while at least one job is running to release threads.
+    if ((m_threadLimit == 0) || std::none_of(m_transcoders.begin(), m_transcoders.end(),
+                                             [](const auto& transcoder) { return transcoder->isTranscoding(); }))
+    {
+        return true;
+    }
+
+    return Player::getStreamingThreadCount() + m_jobThreadEstimate <= static_cast<int>(m_threadLimit);
+}
+
+void TranscoderPool::startNext(size_t index) noexcept
+{
+    // The job prepared by this transcoder goes first, and if nothing else is
+    // pending, jobs prepared by busy transcoders are taken over rather than
+    // leaving this one idle.
+    if (m_preparedJobs[index].source)
+    {
+        m_pendingJobs.push_front(std::move(m_preparedJobs[index]));
+        m_preparedJobs[index] = Job();
+    }
+
+    if (m_pendingJobs.empty())
+    {
+        for (size_t i = 0; i < m_transcoders.size(); ++i)
+        {
+            takePreparedJob(i);
+        }
+    }
+
+    auto& transcoder = *m_transcoders[index];
+    auto it = m_pendingJobs.begin();
+    while (!m_interrupted && (it != m_pendingJobs.end()))
+    {
+        // Jobs writing to the same output files as a running job (typically
+        // when no output directory is specified) must wait for it to finish.
+        if (isWritingTo(it->outputFiles))
+        {
+            ++it;
+            continue;
+        }
+
+        auto job = std::move(*it);
+        it = m_pendingJobs.erase(it);
+
+        if (job.source->isCached)
+        {
+            if (fetchCachedOutputs(*job.source))
+            {
+                std::cout << "Reused cached outputs of " << job.source->uri << std::endl;
+                m_doneWeight += job.weight;
+                job.source->doneWeight += job.weight;
+                finishTask(job.source, true);
+                continue;
+            }
+            job.source->isCached = false;
+        }
+
+        try
+        {
+            if (m_transcoderConfigs[index] != job.config)
+            {
+                transcoder.unserialize(job.config);
+                m_transcoderConfigs[index] = job.config;
+            }
+
+            const auto& encoders = transcoder.getEncoders();
+            for (size_t i = 0; (i < encoders.size()) && (i < job.outputFiles.size()); ++i)
+            {
+                encoders[i]->setOutputFile(job.outputFiles[i]);
+            }
+
+            std::cout << "Start transcoding " << job.source->uri;
+            if (job.startTime != Player::undefinedTime)
+            {
+                std::cout << " from " << static_cast<double>(job.startTime) / GST_SECOND << "s";
+            }
+            if (job.endTime != Player::undefinedTime)
+            {
+                std::cout << " to " << static_cast<double>(job.endTime) / GST_SECOND << "s";
+            }
+            std::cout << "..." << std::endl;
+
+            transcoder.setPlaybackRange(job.startTime, job.endTime, job.seekMode);
+            transcoder.start(job.source->uri);
+            m_runningJobs[index] = std::move(job);
+            prepareNext(index);
+            return;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Cannot start transcoding " << job.source->uri << ": " << e.what() << std::endl;
+            m_doneWeight += job.weight;
+            job.source->doneWeight += job.weight;
+            finishTask(job.source, false);
+            it = m_pendingJobs.begin();
+        }
+    }
+}
+
+void TranscoderPool::prepareNext(size_t index) noexcept
+{
+    if (!m_isLookaheadEnabled || m_interrupted)
+    {
+        return;
+    }
+
+    // Only a job which doesn't require reconfiguring the transcoder can be
+    // prerolled ahead, as encoders are still in use by the running job.
+    for (auto it = m_pendingJobs.begin(); it != m_pendingJobs.end(); ++it)
+    {
+        if (it->config == m_transcoderConfigs[index])
+        {
+            try
+            {
+                if (m_transcoders[index]->prepare(it->source->uri, it->startTime, it->endTime, it->seekMode))
+                {
+                    m_preparedJobs[index] = std::move(*it);
+                    m_pendingJobs.erase(it);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Cannot preroll " << it->source->uri << ": " << e.what() << std::endl;
+            }
+            return;
+        }
+    }
+}
+
+void TranscoderPool::takePreparedJob(size_t index) noexcept
+{
+    if (m_preparedJobs[index].source)
+    {
+        m_transcoders[index]->cancelPreparation();
+        m_pendingJobs.push_front(std::move(m_preparedJobs[index]));
+        m_preparedJobs[index] = Job();
+    }
+}
+
+void TranscoderPool::finishTask(const std::shared_ptr<Source>& source, bool isSuccess) noexcept
+{
+    if (!source)
+    {
+        return;
+    }
+
+    source->isSuccess = source->isSuccess && isSuccess && !m_interrupted;
+    if (--source->remainingTasks > 0)
+    {
+        return;
+    }
+
+    if (!source->partFiles.empty() && source->isSuccess)
+    {
+        stitchSource(source);
+    }
+    else
+    {
+        finishSource(*source);
+    }
+}
+
+void TranscoderPool::stitchSource(const std::shared_ptr<Source>& source) noexcept
+{
+    const auto& entries = source->config.at(Transcoder::encodersKey);
+    source->remainingTasks = source->partFiles.size();
+    for (size_t i = 0; i < source->partFiles.size(); ++i)
+    {
+        try
+        {
+            std::cout << "Stitching " << source->outputFiles[i] << "..." << std::endl;
+            auto encoder = Encoder::createEncoder(entries[i].at(ISerializable::typeKey).get<std::string>());
+            encoder->unserialize(entries[i]);
+
+            const auto audioFile = (i < source->audioFiles.size()) ? source->audioFiles[i] : std::string();
+            auto stitcher =
+                std::make_unique<Stitcher>(*encoder, source->partFiles[i], audioFile, source->outputFiles[i]);
+            auto weakPool = std::weak_ptr<TranscoderPool>(shared_from_this());
+            stitcher->start([weakPool, stitcher = stitcher.get(), source](bool isSuccess) {
+                // Stitcher can't be destroyed from its own bus callback.
+                Glib::signal_idle().connect_once([weakPool, stitcher, source, isSuccess]() {
+                    auto pool = weakPool.lock();
+                    if (pool)
+                    {
+                        auto& stitchers = pool->m_stitchers;
+                        stitchers.erase(std::remove_if(stitchers.begin(), stitchers.end(),
+                                                       [stitcher](const std::unique_ptr<Stitcher>& entry) {
+                                                           return entry.get() == stitcher;
+                                                       }),
+                                        stitchers.end());
+
+                        source->isSuccess = source->isSuccess && isSuccess;
+                        if (--source->remainingTasks == 0)
+                        {
+                            pool->finishSource(*source);
+                        }
+                        pool->quitIfIdle();
+                    }
+                });
+            });
+            m_stitchers.push_back(std::move(stitcher));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Cannot stitch " << source->outputFiles[i] << ": " << e.what() << std::endl;
+            source->isSuccess = false;
+            if (--source->remainingTasks == 0)
+            {
+                finishSource(*source);
+            }
+        }
+    }
+}
+
+void TranscoderPool::finishSource(const Source& source) noexcept
+{
+    for (const auto& files : source.partFiles)
+    {
+        for (const auto& file : files)
+        {
+            std::remove(file.c_str());
+        }
+    }
+
+    for (const auto& file : source.audioFiles)
+    {
+        if (!file.empty())
+        {
+            std::remove(file.c_str());
+        }
+    }
+
+    if (m_cache && source.isSuccess && !source.isCached)
+    {
+        for (size_t i = 0; (i < source.cacheKeys.size()) && (i < source.outputFiles.size()); ++i)
+        {
+            m_cache->store(source.cacheKeys[i], source.outputFiles[i]);
+        }
+    }
+
+    m_results.emplace_back(source.uri, source.isSuccess);
+    std::cout << "[" << m_results.size() << "/" << m_totalCount << "] " << (source.isSuccess ? "OK     " : "FAILED ")
+              << source.uri << std::endl;
+
+    if (source.slotFinished)
+    {
+        source.slotFinished(source.id, source.uri, source.isSuccess);
+    }
+
+    const auto id = source.id;
+    m_sources.erase(id);
+}
+
+void TranscoderPool::quitIfIdle() noexcept
+{
+    // The main loop is only run by the blocking transcode() method, when
+    // driven from an external main loop the pool just stays idle.
+    if ((getRunningCount() == 0) && m_mainLoop->is_running())
+    {
+        m_mainLoop->quit();
+    }
+}
+
+void TranscoderPool::printSummary() const
+{
+    size_t failed = 0;
+    for (const auto& result : m_results)
+    {
+        if (!result.second)
+        {
+            ++failed;
+        }
+    }
+
+    std::cout << "Transcoded " << m_results.size() - failed << "/" << m_totalCount << " source(s) successfully";
+    if (failed != 0)
+    {
+        std::cout << ", " << failed << " failed:" << std::endl;
+        for (const auto& result : m_results)
+        {
+            if (!result.second)
+            {
+                std::cout << "  " << result.first << std::endl;
+            }
+        }
+    }
+    else
+    {
+        std::cout << "." << std::endl;
+    }
+
+    if (m_isRecyclingEnabled)
+    {
+        unsigned int recycleCount = 0;
+        for (const auto& transcoder : m_transcoders)
+        {
+            recycleCount += transcoder->getRecycleCount();
+        }
+        std::cout << "Pipelines reused for " << recycleCount << " job(s)." << std::endl;
+    }
+
+    if (m_cache)
+    {
+        m_cache->printSummary();
+    }
+
+    if (FileReader::getReadBytes() > 0)
+    {
+        FileReader::printSummary();
+    }
+
+    if (FileWriter::getWrittenBytes() > 0)
+    {
+        FileWriter::printSummary();
+    }
+
+    const auto probeHits = SourceProbe::getInstance().getHitCount();
+    if (probeHits > 0)
+    {
+        std::cout << "Source probes reused: " << probeHits << "." << std::endl;
+    }
+
+    std::cout << "Streaming threads peak: " << Player::getPeakStreamingThreadCount();
+    if (m_threadLimit > 0)
+    {
+        std::cout << " (limit " << m_threadLimit << ")";
+    }
+    std::cout << "." << std::endl;
+}
@@ -0,0 +1,146 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "OutputCache.h"
+#include "Transcoder.h"
+#include "encoders/Stitcher.h"
+#include <deque>
+#include <functional>
+#include <map>
+
+class TranscoderPool final : public ITranscoderListener,
+                             public ISerializable,
+                             public std::enable_shared_from_this<TranscoderPool>
+{
+  public:
+    using SlotFinished = std::function<void(unsigned long id, const Glib::ustring& uri, bool isSuccess)>;
+
+    static std::shared_ptr<TranscoderPool> create(int argc, char** argv, unsigned int jobs,
+                                                  bool forceSoftwareEncoding = false);
+    ~TranscoderPool() final = default;
+
+    TranscoderPool(const TranscoderPool&) = delete;
+    TranscoderPool& operator=(const TranscoderPool&) = delete;
+    TranscoderPool(TranscoderPool&&) = delete;
+    TranscoderPool& operator=(TranscoderPool&&) = delete;
+
+    unsigned int getJobCount() const noexcept
+    {
+        return static_cast<unsigned int>(m_transcoders.size());
+    }
+
+    void setOutputDirectory(const std::string& dir) noexcept;
+    void setPipelineRecycling(bool isEnabled);
+    void setLookahead(bool isEnabled) noexcept;
+    void setStageDump(bool isEnabled) noexcept;
+    void setThreadLimit(unsigned int maxThreads = 0) noexcept;
+    unsigned int getThreadsPerJob() const noexcept
+    {
+        return m_threadsPerJob;
+    }
+    void setSegmentation(unsigned int segmentCount = 0, unsigned int segmentDurationInSec = 0) noexcept;
+    void setOutputCache(const std::string& dir = std::string(), std::uint64_t maxSize = 0);
+
+    unsigned long enqueue(const Glib::ustring& uri, const Json& config, const std::string& outputDir,
+                          const SlotFinished& slot = nullptr);
+    void dispatch() noexcept;
+
+    void transcode(const std::vector<Glib::ustring>& uris);
+    void interruptTranscoding() noexcept;
+    size_t getRunningCount() const noexcept;
+    float getProgress() const noexcept;
+    float getProgress(unsigned long id) const noexcept;
+
+    void onTranscodingFinished(Transcoder& transcoder, const Glib::ustring& uri, bool isSuccess) noexcept final;
+
+    Json serialize() const final;
+    void unserialize(const Json& in) final;
+
+  private:
+    struct Source
+    {
+        unsigned long id = 0;
+        Glib::ustring uri;
+        Json config;
+        std::vector<std::string> outputFiles;
+        std::vector<std::vector<std::string>> partFiles;
+        std::vector<std::string> audioFiles;
+        std::vector<std::string> cacheKeys;
+        bool isCached = false;
+        bool isSinglePass = false;
+        size_t remainingTasks = 0;
+        float doneWeight = 0.F;
+        bool isSuccess = true;
+        SlotFinished slotFinished;
+    };
+
+    struct Job
+    {
+        std::shared_ptr<Source> source;
+        Json config;
+        std::vector<std::string> outputFiles;
+        gint64 startTime = Player::undefinedTime;
+        gint64 endTime = Player::undefinedTime;
+        Player::SeekMode seekMode = Player::SeekMode::accurate;
+        float weight = 1.F;
+    };
+
+    TranscoderPool();
+    std::vector<std::shared_ptr<Transcoder>> m_transcoders;
+    std::vector<Json> m_transcoderConfigs;
+    std::vector<Job> m_runningJobs;
+    std::vector<Job> m_preparedJobs;
+    Glib::RefPtr<Glib::MainLoop> m_mainLoop;
+    Json m_config;
+    std::string m_outputDirectory;
+
+    bool m_isRecyclingEnabled;
+    bool m_isLookaheadEnabled;
+    unsigned int m_threadLimit;
+    unsigned int m_threadsPerJob;
+    int m_jobThreadEstimate;
+    unsigned int m_segmentCount;
+    unsigned int m_segmentDurationInSec;
+    std::vector<std::unique_ptr<Stitcher>> m_stitchers;
+    std::unique_ptr<OutputCache> m_cache;
+
+    std::deque<Job> m_pendingJobs;
+    std::map<unsigned long, std::shared_ptr<Source>> m_sources;
+    unsigned long m_lastSourceId;
+
+    std::vector<std::pair<Glib::ustring, bool>> m_results;
+    size_t m_totalCount;
+    float m_doneWeight;
+    bool m_interrupted;
+
+    bool isAssigned(const std::vector<std::string>& files) const noexcept;
+    bool isWritingTo(const std::vector<std::string>& files) const noexcept;
+    void lookupCache(Source& source) noexcept;
+    bool fetchCachedOutputs(const Source& source) noexcept;
+    bool canStartJob() const noexcept;
+    void startNext(size_t index) noexcept;
+    void prepareNext(size_t index) noexcept;
+    void takePreparedJob(size_t index) noexcept;
+    void finishTask(const std::shared_ptr<Source>& source, bool isSuccess) noexcept;
+    void stitchSource(const std::shared_ptr<Source>& source) noexcept;
+    void finishSource(const Source& source) noexcept;
+    void quitIfIdle() noexcept;
+    void printSummary() const;
+};
@@ -17,13 +17,20 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "BitrateCodec.h"
+#include "../exceptions.h"
+#include <algorithm>
+#include <array>
 
 namespace
 {
 constexpr const char* bitrateInKbpsKey = "bitrate";
+constexpr const char* speedInPercentKey = "speed";
+
+constexpr std::array<std::pair<const char*, int>, 5> speedPresets = {
+    {{"slowest", 0}, {"slow", 25}, {"medium", 50}, {"fast", 75}, {"fastest", 100}}};
 } // namespace
 
-BitrateCodec::BitrateCodec() : m_bitrateInKbps(defaultValue)
+BitrateCodec::BitrateCodec() : m_bitrateInKbps(defaultValue), m_speedInPercent(defaultValue)
 {
     // Empty constructor.
 }
@@ -33,6 +40,11 @@ void BitrateCodec::setBitrate(int kbps) noexcept
     m_bitrateInKbps = (kbps >= 0) ? kbps : defaultValue;
 }
 
+void BitrateCodec::setSpeed(int percent) noexcept
+{
+    m_speedInPercent = (percent >= 0) ? std::min(percent, 100) : defaultValue;
+}
+
 Json BitrateCodec::serialize() const
 {
     Json obj = Codec::serialize();
@@ -42,6 +54,11 @@ Json BitrateCodec::serialize() const
         obj[bitrateInKbpsKey] = m_bitrateInKbps;
     }
 
+    if (m_speedInPercent != defaultValue)
+    {
+        obj[speedInPercentKey] = m_speedInPercent;
+    }
+
     return obj;
 }
 
@@ -55,4 +72,38 @@ void BitrateCodec::unserialize(const Json& in)
         bitrate = in.at(bitrateInKbpsKey).get<int>();
     }
     setBitrate(bitrate);
+
+    int speed = defaultValue;
+    if (in.contains(speedInPercentKey))
+    {
+        const Json& entry = in.at(speedInPercentKey);
+        if (entry.is_string())
+        {
+            const auto name = entry.get<std::string>();
+            auto it = std::find_if(speedPresets.begin(), speedPresets.end(),
+                                   [&name](const auto& preset) { return name == preset.first; });
+            if (it == speedPresets.end())
+            {
+                throw InvalidValueException();
+            }
+            speed = it->second;
+        }
+        else
+        {
+            speed = entry.get<int>();
+        }
+    }
+    setSpeed(speed);
+}
+
+int BitrateCodec::getSpeedLevel(int slowest, int medium, int fastest) const noexcept
+{
+    // Piecewise linear, so that 50% always maps to the element medium level
+    // whatever the range of its setting on each side.
+    if (m_speedInPercent <= 50)
+    {
+        return slowest + (medium - slowest) * std::max(m_speedInPercent, 0) / 50;
+    }
+
+    return medium + (fastest - medium) * (m_speedInPercent - 50) / 50;
 }
@@ -26,10 +26,18 @@ class BitrateCodec : public Codec
     BitrateCodec();
 
     void setBitrate(int kbps = defaultValue) noexcept;
+    int getBitrate() const noexcept
+    {
+        return m_bitrateInKbps;
+    }
+    void setSpeed(int percent = defaultValue) noexcept;
 
     Json serialize() const override;
     void unserialize(const Json& in) override;
 
   protected:
     int m_bitrateInKbps;
+    int m_speedInPercent;
+
+    int getSpeedLevel(int slowest, int medium, int fastest) const noexcept;
 };
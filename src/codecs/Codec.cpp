@@ -77,6 +77,11 @@ std::shared_ptr<Codec> Codec::createCodec(const std::string& type)
     throw InvalidTypeException();
 }
 
+Codec::Codec() : m_isPassthroughEnabled(false)
+{
+    // Empty constructor.
+}
+
 void Codec::forceSoftwareEncoding(bool force) noexcept
 {
     H264Codec::forceSoftwareEncoding(force);
@@ -89,13 +94,31 @@ Json Codec::serialize() const
 {
     Json obj = Json::object();
     obj[ISerializable::typeKey] = getType();
+
+    if (m_isPassthroughEnabled)
+    {
+        obj[passthroughKey] = true;
+    }
+
     return obj;
 }
 
+void Codec::setPassthrough(bool isEnabled) noexcept
+{
+    m_isPassthroughEnabled = isEnabled;
+}
+
 void Codec::unserialize(const Json& in)
 {
     if (in.at(ISerializable::typeKey).get<std::string>() != getType())
     {
         throw InvalidTypeException();
     }
+
+    bool isPassthroughEnabled = false;
+    if (in.contains(passthroughKey))
+    {
+        isPassthroughEnabled = in.at(passthroughKey).get<bool>();
+    }
+    setPassthrough(isPassthroughEnabled);
 }
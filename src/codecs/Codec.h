@@ -25,11 +25,12 @@ class Codec : public ISerializable
 {
   public:
     static constexpr int defaultValue = -1;
+    static constexpr const char* passthroughKey = "passthrough";
 
     static std::shared_ptr<Codec> createCodec(const std::string& type);
     static void forceSoftwareEncoding(bool force) noexcept;
 
-    Codec() = default;
+    Codec();
 
     Codec(const Codec&) = delete;
     Codec& operator=(const Codec&) = delete;
@@ -39,8 +40,18 @@ class Codec : public ISerializable
     Json serialize() const override;
     void unserialize(const Json& in) override;
 
+    // Allows to copy source streams already encoded with this codec.
+    void setPassthrough(bool isEnabled = false) noexcept;
+    bool isPassthroughEnabled() const noexcept
+    {
+        return m_isPassthroughEnabled;
+    }
+
     virtual const char* getType() const noexcept = 0;
     virtual const char* getMimeType() const noexcept = 0;
     virtual void configureElement(const Glib::ustring& factoryName,
                                   const Glib::RefPtr<Gst::Element>& element) const = 0;
+
+  private:
+    bool m_isPassthroughEnabled;
 };
@@ -0,0 +1,181 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MultithreadedCodec.h"
+#include "../ResourceDiscovery.h"
+#include <algorithm>
+
+namespace
+{
+constexpr const char* threadsKey = "threads";
+constexpr const char* slicedThreadingKey = "slicedthreads";
+constexpr const char* tileColumnsKey = "tilecolumns";
+constexpr const char* rowMultithreadingKey = "rowmt";
+
+// Roughly a quarter of a 1080p frame per thread: 2 threads for 480p, 8 for
+// 1080p and 32 for 2160p (before being capped by the thread limit).
+constexpr int pixelsPerThread = 256 * 1024;
+
+constexpr int minTileWidth = 256;
+constexpr int maxTileColumns = 6;
+} // namespace
+
+MultithreadedCodec::MultithreadedCodec()
+    : m_threads(defaultValue), m_isSlicedThreadingEnabled(false), m_tileColumns(defaultValue),
+      m_isRowMultithreadingEnabled(true), m_frameWidth(defaultValue), m_frameHeight(defaultValue),
+      m_threadLimit(defaultValue)
+{
+    // Empty constructor.
+}
+
+void MultithreadedCodec::setThreads(int n) noexcept
+{
+    m_threads = (n > 0) ? n : defaultValue;
+}
+
+void MultithreadedCodec::setSlicedThreading(bool isEnabled) noexcept
+{
+    m_isSlicedThreadingEnabled = isEnabled;
+}
+
+void MultithreadedCodec::setTileColumns(int log2Columns) noexcept
+{
+    m_tileColumns = (log2Columns >= 0) ? std::min(log2Columns, maxTileColumns) : defaultValue;
+}
+
+void MultithreadedCodec::setRowMultithreading(bool isEnabled) noexcept
+{
+    m_isRowMultithreadingEnabled = isEnabled;
+}
+
+void MultithreadedCodec::setFrameSize(int width, int height) noexcept
+{
+    m_frameWidth = (width > 0) ? width : defaultValue;
+    m_frameHeight = (height > 0) ? height : defaultValue;
+}
+
+void MultithreadedCodec::setThreadLimit(int n) noexcept
+{
+    m_threadLimit = (n > 0) ? n : defaultValue;
+}
+
+Json MultithreadedCodec::serialize() const
+{
+    Json obj = BitrateOrQualityCodec::serialize();
+
+    if (m_threads != defaultValue)
+    {
+        obj[threadsKey] = m_threads;
+    }
+
+    if (m_isSlicedThreadingEnabled)
+    {
+        obj[slicedThreadingKey] = true;
+    }
+
+    if (m_tileColumns != defaultValue)
+    {
+        obj[tileColumnsKey] = m_tileColumns;
+    }
+
+    if (!m_isRowMultithreadingEnabled)
+    {
+        obj[rowMultithreadingKey] = false;
+    }
+
+    return obj;
+}
+
+void MultithreadedCodec::unserialize(const Json& in)
+{
+    BitrateOrQualityCodec::unserialize(in);
+
+    int threads = defaultValue;
+    if (in.contains(threadsKey))
+    {
+        threads = in.at(threadsKey).get<int>();
+    }
+    setThreads(threads);
+
+    bool isSlicedThreadingEnabled = false;
+    if (in.contains(slicedThreadingKey))
+    {
+        isSlicedThreadingEnabled = in.at(slicedThreadingKey).get<bool>();
+    }
+    setSlicedThreading(isSlicedThreadingEnabled);
+
+    int tileColumns = defaultValue;
+    if (in.contains(tileColumnsKey))
+    {
+        tileColumns = in.at(tileColumnsKey).get<int>();
+    }
+    setTileColumns(tileColumns);
+
+    bool isRowMultithreadingEnabled = true;
+    if (in.contains(rowMultithreadingKey))
+    {
+        isRowMultithreadingEnabled = in.at(rowMultithreadingKey).get<bool>();
+    }
+    setRowMultithreading(isRowMultithreadingEnabled);
+}
+
+int MultithreadedCodec::getThreadCount() const noexcept
+{
+    const int limit = (m_threadLimit != defaultValue)
+                          ? m_threadLimit
+                          : static_cast<int>(ResourceDiscovery::getInstance().getCpuCount());
+
+    if (m_threads != defaultValue)
+    {
+        return std::min(m_threads, limit);
+    }
+
+    if ((m_frameWidth == defaultValue) || (m_frameHeight == defaultValue))
+    {
+        return limit;
+    }
+
+    const int threads = (m_frameWidth * m_frameHeight + pixelsPerThread - 1) / pixelsPerThread;
+    return std::clamp(threads, 1, limit);
+}
+
+int MultithreadedCodec::getTileColumns() const noexcept
+{
+    if (m_tileColumns != defaultValue)
+    {
+        return m_tileColumns;
+    }
+
+    // Tiles narrower than 256 pixels are not allowed, and more tiles than
+    // threads don't bring anything but compression overhead.
+    int columns = 0;
+    const int threads = getThreadCount();
+    const int width = (m_frameWidth != defaultValue) ? m_frameWidth : 0;
+    while ((columns < maxTileColumns) && ((minTileWidth << (columns + 1)) <= width) && ((2 << columns) <= threads))
+    {
+        ++columns;
+    }
+
+    return columns;
+}
+
+bool MultithreadedCodec::hasProperty(const Glib::RefPtr<Gst::Element>& element, const char* name) noexcept
+{
+    // Some properties (such as vp9enc row-mt) depend on the plugins version.
+    return g_object_class_find_property(G_OBJECT_GET_CLASS(element->gobj()), name) != nullptr; // NOLINT
+}
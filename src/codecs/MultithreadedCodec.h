@@ -0,0 +1,54 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "BitrateOrQualityCodec.h"
+
+class MultithreadedCodec : public BitrateOrQualityCodec
+{
+  public:
+    MultithreadedCodec();
+
+    void setThreads(int n = defaultValue) noexcept;
+    void setSlicedThreading(bool isEnabled = false) noexcept;
+    void setTileColumns(int log2Columns = defaultValue) noexcept;
+    void setRowMultithreading(bool isEnabled = true) noexcept;
+
+    // Runtime hints, not serialized.
+    void setFrameSize(int width = defaultValue, int height = defaultValue) noexcept;
+    void setThreadLimit(int n = defaultValue) noexcept;
+
+    Json serialize() const override;
+    void unserialize(const Json& in) override;
+
+  protected:
+    int m_threads;
+    bool m_isSlicedThreadingEnabled;
+    int m_tileColumns;
+    bool m_isRowMultithreadingEnabled;
+
+    int m_frameWidth;
+    int m_frameHeight;
+    int m_threadLimit;
+
+    int getThreadCount() const noexcept;
+    int getTileColumns() const noexcept;
+
+    static bool hasProperty(const Glib::RefPtr<Gst::Element>& element, const char* name) noexcept;
+};
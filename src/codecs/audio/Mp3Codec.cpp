@@ -29,6 +29,11 @@ constexpr int defaultBitrate = 128;
 constexpr float minQP = 0.F;
 constexpr float maxQP = 9.999F;
 constexpr float defaultQP = 4.F;
+
+// encoding-engine-quality values, from high to fast.
+constexpr int slowestEngineQuality = 2;
+constexpr int mediumEngineQuality = 1;
+constexpr int fastestEngineQuality = 0;
 } // namespace
 
 const char* Mp3Codec::getMimeType() const noexcept
@@ -61,6 +66,12 @@ void Mp3Codec::configureElement(const Glib::ustring& factoryName, const Glib::Re
             element->set_property("quality", qp);
             break;
         }
+
+        if (m_speedInPercent != defaultValue)
+        {
+            element->set_property("encoding-engine-quality",
+                                  getSpeedLevel(slowestEngineQuality, mediumEngineQuality, fastestEngineQuality));
+        }
     }
     else
     {
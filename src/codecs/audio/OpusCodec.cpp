@@ -25,6 +25,10 @@ namespace
 constexpr int minBitrate = 4;
 constexpr int maxBitrate = 650;
 constexpr int defaultBitrate = 64;
+
+constexpr int slowestComplexity = 10;
+constexpr int mediumComplexity = 5;
+constexpr int fastestComplexity = 0;
 } // namespace
 
 const char* OpusCodec::getMimeType() const noexcept
@@ -41,6 +45,10 @@ void OpusCodec::configureElement(const Glib::ustring& factoryName, const Glib::R
     {
         element->set_property("bitrate-type", 1);
         element->set_property("bitrate", bitrate * 1000);
+        if (m_speedInPercent != defaultValue)
+        {
+            element->set_property("complexity", getSpeedLevel(slowestComplexity, mediumComplexity, fastestComplexity));
+        }
     }
     else
     {
@@ -29,6 +29,16 @@ constexpr int defaultBitrate = 2048;
 constexpr int minQP = 1;
 constexpr int maxQP = 51;
 constexpr int defaultQP = 26;
+
+// speed-preset values, from veryslow to ultrafast (placebo is not used).
+constexpr int slowestPreset = 9;
+constexpr int mediumPreset = 6;
+constexpr int fastestPreset = 1;
+
+// quality-level values of vaapi encoders.
+constexpr int slowestQualityLevel = 1;
+constexpr int mediumQualityLevel = 4;
+constexpr int fastestQualityLevel = 7;
 } // namespace
 
 void H264Codec::forceSoftwareEncoding(bool force) noexcept
@@ -78,6 +88,14 @@ void H264Codec::configureElement(const Glib::ustring& factoryName, const Glib::R
             element->set_property("quantizer", qp - 1);
             break;
         }
+
+        if (m_speedInPercent != defaultValue)
+        {
+            element->set_property("speed-preset", getSpeedLevel(slowestPreset, mediumPreset, fastestPreset));
+        }
+
+        element->set_property("threads", static_cast<guint>(getThreadCount()));
+        element->set_property("sliced-threads", m_isSlicedThreadingEnabled);
     }
     else if (factoryName == "vaapih264enc")
     {
@@ -97,6 +115,12 @@ void H264Codec::configureElement(const Glib::ustring& factoryName, const Glib::R
             element->set_property("init-qp", qp);
             break;
         }
+
+        if (m_speedInPercent != defaultValue)
+        {
+            element->set_property("quality-level",
+                                  getSpeedLevel(slowestQualityLevel, mediumQualityLevel, fastestQualityLevel));
+        }
     }
     else
     {
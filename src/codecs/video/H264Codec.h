@@ -18,9 +18,9 @@
  */
 #pragma once
 
-#include "../BitrateOrQualityCodec.h"
+#include "../MultithreadedCodec.h"
 
-class H264Codec final : public BitrateOrQualityCodec
+class H264Codec final : public MultithreadedCodec
 {
   public:
     static constexpr const char* type = "h264";
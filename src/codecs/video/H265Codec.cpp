@@ -29,6 +29,16 @@ constexpr int defaultBitrate = 2048;
 constexpr int minQP = 1;
 constexpr int maxQP = 51;
 constexpr int defaultQP = 26;
+
+// speed-preset values, from veryslow to ultrafast (placebo is not used).
+constexpr int slowestPreset = 9;
+constexpr int mediumPreset = 6;
+constexpr int fastestPreset = 1;
+
+// quality-level values of vaapi encoders.
+constexpr int slowestQualityLevel = 1;
+constexpr int mediumQualityLevel = 4;
+constexpr int fastestQualityLevel = 7;
 } // namespace
 
 void H265Codec::forceSoftwareEncoding(bool force) noexcept
@@ -47,6 +57,27 @@ void H265Codec::forceSoftwareEncoding(bool force) noexcept
     }
 }
 
+int H265Codec::getFrameThreadCount(int threads) noexcept
+{
+    // Same scale as the one used by x265 when detecting CPU cores itself.
+    if (threads >= 32)
+    {
+        return 6;
+    }
+
+    if (threads >= 16)
+    {
+        return 5;
+    }
+
+    if (threads >= 8)
+    {
+        return 3;
+    }
+
+    return (threads >= 4) ? 2 : 1;
+}
+
 const char* H265Codec::getMimeType() const noexcept
 {
     return "video/x-h265";
@@ -76,6 +107,17 @@ void H265Codec::configureElement(const Glib::ustring& factoryName, const Glib::R
             element->set_property("qp", qp);
             break;
         }
+
+        if (m_speedInPercent != defaultValue)
+        {
+            element->set_property("speed-preset", getSpeedLevel(slowestPreset, mediumPreset, fastestPreset));
+        }
+
+        // x265enc doesn't expose threading properties, they are given to the
+        // x265 library as options.
+        const int threads = getThreadCount();
+        element->set_property("option-string", Glib::ustring::compose("pools=%1:frame-threads=%2", threads,
+                                                                      getFrameThreadCount(threads)));
     }
     else if (factoryName == "vaapih265enc")
     {
@@ -95,6 +137,12 @@ void H265Codec::configureElement(const Glib::ustring& factoryName, const Glib::R
             element->set_property("init-qp", qp);
             break;
         }
+
+        if (m_speedInPercent != defaultValue)
+        {
+            element->set_property("quality-level",
+                                  getSpeedLevel(slowestQualityLevel, mediumQualityLevel, fastestQualityLevel));
+        }
     }
     else
     {
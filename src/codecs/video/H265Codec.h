@@ -18,9 +18,9 @@
  */
 #pragma once
 
-#include "../BitrateOrQualityCodec.h"
+#include "../MultithreadedCodec.h"
 
-class H265Codec final : public BitrateOrQualityCodec
+class H265Codec final : public MultithreadedCodec
 {
   public:
     static constexpr const char* type = "h265";
@@ -34,4 +34,7 @@ class H265Codec final : public BitrateOrQualityCodec
 
     const char* getMimeType() const noexcept final;
     void configureElement(const Glib::ustring& factoryName, const Glib::RefPtr<Gst::Element>& element) const final;
+
+  private:
+    static int getFrameThreadCount(int threads) noexcept;
 };
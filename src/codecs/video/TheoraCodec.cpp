@@ -29,6 +29,10 @@ constexpr int defaultBitrate = 2048;
 constexpr int minQP = 0;
 constexpr int maxQP = 63;
 constexpr int defaultQP = 48;
+
+constexpr int slowestSpeedLevel = 0;
+constexpr int mediumSpeedLevel = 1;
+constexpr int fastestSpeedLevel = 2;
 } // namespace
 
 const char* TheoraCodec::getMimeType() const noexcept
@@ -60,6 +64,11 @@ void TheoraCodec::configureElement(const Glib::ustring& factoryName, const Glib:
             element->set_property("quality", qp);
             break;
         }
+
+        if (m_speedInPercent != defaultValue)
+        {
+            element->set_property("speed-level", getSpeedLevel(slowestSpeedLevel, mediumSpeedLevel, fastestSpeedLevel));
+        }
     }
     else
     {
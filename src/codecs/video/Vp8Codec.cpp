@@ -29,6 +29,15 @@ constexpr int defaultBitrate = 2048;
 constexpr int minQP = 1;
 constexpr int maxQP = 7;
 constexpr int defaultQP = 2;
+
+constexpr gint64 bestQualityDeadline = 0;
+constexpr gint64 realtimeDeadline = 1;
+constexpr gint64 goodQualityDeadline = 1000000;
+constexpr int realtimeSpeed = 90;
+
+constexpr int slowestCpuUsed = 0;
+constexpr int mediumCpuUsed = 2;
+constexpr int fastestCpuUsed = 16;
 } // namespace
 
 void Vp8Codec::forceSoftwareEncoding(bool force) noexcept
@@ -78,6 +87,24 @@ void Vp8Codec::configureElement(const Glib::ustring& factoryName, const Glib::Re
             element->set_property("cq-level", 10 * (qp - 1));
             break;
         }
+
+        if (m_speedInPercent != defaultValue)
+        {
+            gint64 deadline = goodQualityDeadline;
+            if (m_speedInPercent == 0)
+            {
+                deadline = bestQualityDeadline;
+            }
+            else if (m_speedInPercent >= realtimeSpeed)
+            {
+                deadline = realtimeDeadline;
+            }
+
+            element->set_property("deadline", deadline);
+            element->set_property("cpu-used", getSpeedLevel(slowestCpuUsed, mediumCpuUsed, fastestCpuUsed));
+        }
+
+        element->set_property("threads", getThreadCount());
     }
     else if (factoryName == "vaapivp8enc")
     {
@@ -18,9 +18,9 @@
  */
 #pragma once
 
-#include "../BitrateOrQualityCodec.h"
+#include "../MultithreadedCodec.h"
 
-class Vp8Codec final : public BitrateOrQualityCodec
+class Vp8Codec final : public MultithreadedCodec
 {
   public:
     static constexpr const char* type = "vp8";
@@ -0,0 +1,181 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "CodecStage.h"
+#include "../exceptions.h"
+#include "Encoder.h"
+
+CodecStage::CodecStage(const std::shared_ptr<Codec>& codec, const Glib::RefPtr<Gst::Caps>& restrictionCaps,
+                       GstStreamType streamType)
+    : m_codec(codec), m_restrictionCaps(restrictionCaps), m_streamType(streamType)
+{
+    if (!m_codec)
+    {
+        throw NoCodecException();
+    }
+}
+
+CodecStage::~CodecStage()
+{
+    for (auto& branch : m_branches)
+    {
+        releaseBranch(branch);
+    }
+}
+
+void CodecStage::connect(Player& player, size_t index, Connector& connector, const Glib::RefPtr<Gst::Pad>& sinkPad,
+                         const QueueSettings& queueSettings)
+{
+    Branch* branch = nullptr;
+    size_t count = 0;
+    for (auto& entry : m_branches)
+    {
+        if (entry.encodeBin->has_as_parent(player.getPipeline()) && (count++ == index))
+        {
+            branch = &entry;
+            break;
+        }
+    }
+
+    if (branch == nullptr)
+    {
+        branch = &createBranch(player, connector, queueSettings);
+    }
+
+    // Each encoder gets its own queue, as for connectors outputs.
+    auto queue = Gst::Queue::create();
+    player.getPipeline()->add(queue);
+    branch->outputQueues.push_back(queue);
+
+    if ((branch->outputTee->get_request_pad("src_%u")->link(queue->get_static_pad("sink")) != Gst::PAD_LINK_OK) ||
+        (queue->get_static_pad("src")->link(sinkPad) != Gst::PAD_LINK_OK))
+    {
+        throw CannotLinkPadException();
+    }
+
+    if (!queue->sync_state_with_parent())
+    {
+        throw InvalidStateException();
+    }
+}
+
+void CodecStage::setLocked(const Glib::RefPtr<Gst::Object>& pipeline, bool isLocked)
+{
+    for (auto& branch : m_branches)
+    {
+        if (!branch.encodeBin->has_as_parent(pipeline))
+        {
+            continue;
+        }
+
+        std::vector<Glib::RefPtr<Gst::Element>> elements{branch.encodeBin, branch.outputTee};
+        elements.insert(elements.end(), branch.outputQueues.begin(), branch.outputQueues.end());
+        for (auto& element : elements)
+        {
+            element->set_locked_state(isLocked);
+            if (!isLocked && !element->sync_state_with_parent())
+            {
+                throw InvalidStateException();
+            }
+        }
+    }
+}
+
+void CodecStage::release(const Glib::RefPtr<Gst::Object>& pipeline) noexcept
+{
+    std::vector<Branch> branches;
+    for (auto& branch : m_branches)
+    {
+        if (branch.encodeBin->has_as_parent(pipeline))
+        {
+            releaseBranch(branch);
+        }
+        else
+        {
+            branches.push_back(std::move(branch));
+        }
+    }
+
+    m_branches.swap(branches);
+}
+
+CodecStage::Branch& CodecStage::createBranch(Player& player, Connector& connector, const QueueSettings& queueSettings)
+{
+    // A profile without container makes encodebin output the encoded stream.
+    Branch branch;
+    branch.encodeBin = Gst::EncodeBin::create();
+    branch.outputTee = Gst::Tee::create();
+    if (!branch.encodeBin || !branch.outputTee)
+    {
+        throw UnrecoverableError();
+    }
+
+    const bool isVideo = (m_streamType & GST_STREAM_TYPE_VIDEO) != 0;
+    auto format = Gst::Caps::create_from_string(m_codec->getMimeType());
+    GstEncodingProfile* profile =
+        isVideo ? reinterpret_cast<GstEncodingProfile*>( // NOLINT
+                      gst_encoding_video_profile_new(format->gobj(), nullptr, m_restrictionCaps->gobj(), 0))
+                : reinterpret_cast<GstEncodingProfile*>( // NOLINT
+                      gst_encoding_audio_profile_new(format->gobj(), nullptr, m_restrictionCaps->gobj(), 0));
+    branch.encodeBin->property_profile() = Glib::wrap(profile);
+    branch.outputTee->property_allow_not_linked() = true;
+
+    auto pipeline = player.getPipeline();
+    pipeline->add(branch.encodeBin)->add(branch.outputTee);
+    m_branches.push_back(std::move(branch));
+    auto& entry = m_branches.back();
+
+    entry.encodeBin->link(entry.outputTee);
+    if (!entry.encodeBin->sync_state_with_parent() || !entry.outputTee->sync_state_with_parent())
+    {
+        throw InvalidStateException();
+    }
+
+    connector.connect(entry.encodeBin->get_request_pad(isVideo ? "video_%u" : "audio_%u"), queueSettings,
+                      m_restrictionCaps, std::string("shared ") + m_codec->getType() + " encoding");
+
+    Encoder::configureCodecElements(*m_codec, isVideo ? GST_STREAM_TYPE_VIDEO : GST_STREAM_TYPE_AUDIO, entry.encodeBin,
+                                    pipeline->get_bus());
+
+    return entry;
+}
+
+void CodecStage::releaseBranch(Branch& branch) noexcept
+{
+    auto it = branch.outputTee->iterate_src_pads();
+    while (it.next() == Gst::ITERATOR_OK)
+    {
+        branch.outputTee->release_request_pad(*it);
+    }
+
+    std::vector<Glib::RefPtr<Gst::Element>> elements{branch.encodeBin, branch.outputTee};
+    elements.insert(elements.end(), branch.outputQueues.begin(), branch.outputQueues.end());
+    for (auto& element : elements)
+    {
+        element->set_locked_state(false);
+        element->set_state(Gst::STATE_NULL);
+
+        auto parent = Glib::RefPtr<Gst::Bin>::cast_static(element->get_parent());
+        if (parent)
+        {
+            parent->remove(element);
+        }
+    }
+
+    branch.outputQueues.clear();
+}
@@ -0,0 +1,66 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../codecs/Codec.h"
+#include "../player/Player.h"
+
+// Encoding of one stream shared by several encoders with identical codec
+// settings: the stream is encoded once per source stream and the encoded
+// output is fanned out to each encoder, whose encodebin passes it through.
+class CodecStage final
+{
+  public:
+    CodecStage(const std::shared_ptr<Codec>& codec, const Glib::RefPtr<Gst::Caps>& restrictionCaps,
+               GstStreamType streamType);
+    ~CodecStage();
+
+    CodecStage(const CodecStage&) = delete;
+    CodecStage& operator=(const CodecStage&) = delete;
+    CodecStage(CodecStage&&) = delete;
+    CodecStage& operator=(CodecStage&&) = delete;
+
+    const std::shared_ptr<Codec>& getCodec() const noexcept
+    {
+        return m_codec;
+    }
+
+    // Links the output of the index-th stream of the player to sinkPad, the
+    // stream being encoded by the first call for this index.
+    void connect(Player& player, size_t index, Connector& connector, const Glib::RefPtr<Gst::Pad>& sinkPad,
+                 const QueueSettings& queueSettings);
+    void setLocked(const Glib::RefPtr<Gst::Object>& pipeline, bool isLocked);
+    void release(const Glib::RefPtr<Gst::Object>& pipeline) noexcept;
+
+  private:
+    struct Branch
+    {
+        Glib::RefPtr<Gst::EncodeBin> encodeBin;
+        Glib::RefPtr<Gst::Tee> outputTee;
+        std::vector<Glib::RefPtr<Gst::Queue>> outputQueues;
+    };
+
+    std::shared_ptr<Codec> m_codec;
+    Glib::RefPtr<Gst::Caps> m_restrictionCaps;
+    GstStreamType m_streamType;
+    std::vector<Branch> m_branches;
+
+    Branch& createBranch(Player& player, Connector& connector, const QueueSettings& queueSettings);
+    static void releaseBranch(Branch& branch) noexcept;
+};
@@ -16,28 +16,78 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include "../codecs/BitrateCodec.h"
+#include "../codecs/MultithreadedCodec.h"
 #include "../exceptions.h"
+#include "../io/FileWriter.h"
+#include "HlsEncoder.h"
 #include "MkvEncoder.h"
 #include "Mp4Encoder.h"
 #include "OggEncoder.h"
 #include "WebmEncoder.h"
+#include <algorithm>
 
 namespace
 {
-constexpr const char* outputFileKey = "file";
 constexpr const char* videoWidthKey = "width";
 constexpr const char* videoHeightKey = "height";
 constexpr const char* frameRateKey = "framerate";
 constexpr const char* audioChannelsKey = "channels";
 constexpr const char* audioSampleRateKey = "samplerate";
-constexpr const char* videoCodecKey = "video";
-constexpr const char* audioCodecKey = "audio";
+constexpr const char* queueKey = "queue";
+constexpr const char* queueMaxBuffersKey = "buffers";
+constexpr const char* queueMaxBytesKey = "bytes";
+constexpr const char* queueMaxTimeKey = "time";
+constexpr const char* queueLeakyKey = "leaky";
+constexpr const char* tracksKey = "tracks";
+
+Json serializeTracks(const TrackSelection& selection)
+{
+    Json tracks = Json::array();
+    for (const auto index : selection.getIndexes())
+    {
+        tracks.push_back(index);
+    }
+    for (const auto& pattern : selection.getPatterns())
+    {
+        tracks.push_back(pattern);
+    }
+    return tracks;
+}
+
+TrackSelection unserializeTracks(const Json& in)
+{
+    TrackSelection selection;
+    for (const auto& entry : in)
+    {
+        if (entry.is_number())
+        {
+            selection.addIndex(entry.get<int>());
+        }
+        else
+        {
+            selection.addPattern(entry.get<std::string>());
+        }
+    }
+    return selection;
+}
 } // namespace
 
+NLOHMANN_JSON_SERIALIZE_ENUM(QueueSettings::Leaky, // NOLINT
+                             {{QueueSettings::Leaky::defaultValue, ""},
+                              {QueueSettings::Leaky::no, "no"},
+                              {QueueSettings::Leaky::upstream, "upstream"},
+                              {QueueSettings::Leaky::downstream, "downstream"}});
+
 const GQuark Encoder::errorDomain = Glib::Quark("EncoderErrorDomain");
 
 std::shared_ptr<Encoder> Encoder::createEncoder(const std::string& type)
 {
+    if (type == HlsEncoder::type)
+    {
+        return std::make_shared<HlsEncoder>();
+    }
+
     if (type == MkvEncoder::type)
     {
         return std::make_shared<MkvEncoder>();
@@ -61,12 +111,22 @@ std::shared_ptr<Encoder> Encoder::createEncoder(const std::string& type)
     throw InvalidTypeException();
 }
 
-Encoder::Encoder()
-    : m_videoWidth(sameAsSource), m_videoHeight(sameAsSource), m_frameRateNumerator(sameAsSource),
+std::string Encoder::getFileExtension(const std::string& type)
+{
+    // The output file of an hls encoder is its playlist.
+    return (type == HlsEncoder::type) ? "m3u8" : type;
+}
+
+Encoder::Encoder() : Encoder(FileWriter::createSink())
+{
+    // Empty constructor.
+}
+
+Encoder::Encoder(const Glib::RefPtr<Gst::Element>& sink)
+    : m_fileSink(sink), m_videoWidth(sameAsSource), m_videoHeight(sameAsSource), m_frameRateNumerator(sameAsSource),
       m_frameRateDenominator(1), m_audioChannels(sameAsSource), m_audioSampleRate(sameAsSource)
 {
     m_encodeBin = Gst::EncodeBin::create();
-    m_fileSink = Gst::FileSink::create();
 
     if (!m_encodeBin || !m_fileSink)
     {
@@ -84,6 +144,11 @@ void Encoder::setOutputFile(const Glib::ustring& file) noexcept
     m_outputFile = file;
 }
 
+bool Encoder::isStreamed() const noexcept
+{
+    return m_outputFile == FileWriter::standardOutput;
+}
+
 void Encoder::setVideoDimensions(int width, int height) noexcept
 {
     m_videoWidth = (width > 0) ? width : sameAsSource;
@@ -106,6 +171,26 @@ void Encoder::setAudioSampleRate(int rate) noexcept
     m_audioSampleRate = (rate > 0) ? rate : sameAsSource;
 }
 
+void Encoder::setQueueSettings(const QueueSettings& settings) noexcept
+{
+    m_queueSettings.maxBuffers = (settings.maxBuffers >= 0) ? settings.maxBuffers : QueueSettings::defaultValue;
+    m_queueSettings.maxBytes = (settings.maxBytes >= 0) ? settings.maxBytes : QueueSettings::defaultValue;
+    m_queueSettings.maxTimeInMs = (settings.maxTimeInMs >= 0) ? settings.maxTimeInMs : QueueSettings::defaultValue;
+    m_queueSettings.leaky = settings.leaky;
+}
+
+void Encoder::setTrackSelection(GstStreamType streamType, const TrackSelection& selection)
+{
+    if ((streamType & GST_STREAM_TYPE_VIDEO) != 0)
+    {
+        m_videoTracks = selection;
+    }
+    else
+    {
+        m_audioTracks = selection;
+    }
+}
+
 void Encoder::setVideoCodec(const std::shared_ptr<Codec>& codec)
 {
     if (isVideoCodecAccepted(codec->getType()))
@@ -134,6 +219,25 @@ void Encoder::clearCodecs() noexcept
 {
     m_videoCodec.reset();
     m_audioCodec.reset();
+    m_videoStage.reset();
+    m_audioStage.reset();
+}
+
+void Encoder::setCodecStage(GstStreamType streamType, const std::shared_ptr<CodecStage>& stage) noexcept
+{
+    if ((streamType & GST_STREAM_TYPE_VIDEO) != 0)
+    {
+        m_videoStage = stage;
+    }
+    else
+    {
+        m_audioStage = stage;
+    }
+}
+
+Glib::RefPtr<Gst::Caps> Encoder::getRestrictionCaps(GstStreamType streamType) const noexcept
+{
+    return ((streamType & GST_STREAM_TYPE_VIDEO) != 0) ? getVideoCaps() : getAudioCaps();
 }
 
 void Encoder::onPlayerPrerolled(Player& player)
@@ -143,86 +247,200 @@ void Encoder::onPlayerPrerolled(Player& player)
         throw NoCodecException();
     }
 
+    if (m_encodeBin->get_parent())
+    {
+        if (m_encodeBin->has_as_parent(player.getPipeline()) && player.isRecycled())
+        {
+            // Encoder elements are still configured and connected from the
+            // previous source, only the output file changes.
+            configureSink(m_fileSink, getExpectedSize(player));
+            m_encodeBin->set_locked_state(false);
+            m_fileSink->set_locked_state(false);
+            if (!m_encodeBin->sync_state_with_parent() || !m_fileSink->sync_state_with_parent())
+            {
+                throw InvalidStateException();
+            }
+
+            for (const auto& stage : {m_videoStage, m_audioStage})
+            {
+                if (stage)
+                {
+                    stage->setLocked(player.getPipeline(), false);
+                }
+            }
+
+            return;
+        }
+
+        // Elements kept from a source which can't be recycled, possibly in
+        // another player pipeline.
+        cleanupEncoder();
+    }
+
+    // Compressed streams are copied as is, encodebin passes them through when
+    // they match the format of their encoding profile.
+    Glib::RefPtr<Gst::Caps> videoFormat;
+    Glib::RefPtr<Gst::Caps> audioFormat;
+    player.forEachConnector([this, &videoFormat, &audioFormat](Connector& connector) {
+        if (!connector.isRaw() && this->acceptsPassthrough(connector) && this->isSelected(connector))
+        {
+            auto& format = ((connector.getStreamType() & GST_STREAM_TYPE_VIDEO) != 0) ? videoFormat : audioFormat;
+            format = connector.getCaps();
+        }
+    });
+
     // Add encoder elements to pipeline.
     player.getPipeline()->add(m_encodeBin)->add(m_fileSink);
     m_encodeBin->link(m_fileSink);
 
-    m_fileSink->property_location() = m_outputFile;
-    m_encodeBin->property_profile() = createEncodingProfile();
+    configureSink(m_fileSink, getExpectedSize(player));
+    m_encodeBin->property_profile() = createEncodingProfile(videoFormat, audioFormat);
 
     if (!m_encodeBin->sync_state_with_parent() || !m_fileSink->sync_state_with_parent())
     {
         throw InvalidStateException();
     }
 
-    // Connect encoder to player.
-    player.forEachConnector([this](Connector& connector) {
+    // Connect encoder to player, raw streams being encoded by the shared codec
+    // stage if any (the index of the stream identifies its stage branch).
+    size_t videoIndex = 0;
+    size_t audioIndex = 0;
+    player.forEachConnector([this, &player, &videoIndex, &audioIndex](Connector& connector) {
+        if ((!connector.isRaw() && !this->acceptsPassthrough(connector)) || !this->isSelected(connector))
+        {
+            return;
+        }
+
         Glib::RefPtr<Gst::Pad> sinkPad;
+        std::shared_ptr<CodecStage> stage;
+        size_t index = 0;
         if (this->m_videoCodec && ((connector.getStreamType() & GST_STREAM_TYPE_VIDEO) != 0))
         {
             sinkPad = this->m_encodeBin->get_request_pad("video_%u");
+            this->setCodecFrameSize(connector.getCaps());
+            stage = this->m_videoStage;
+            index = videoIndex++;
         }
         else if (this->m_audioCodec && ((connector.getStreamType() & GST_STREAM_TYPE_AUDIO) != 0))
         {
             sinkPad = this->m_encodeBin->get_request_pad("audio_%u");
+            stage = this->m_audioStage;
+            index = audioIndex++;
         }
         else
         {
             return;
         }
 
-        connector.connect(sinkPad);
+        if (stage && connector.isRaw())
+        {
+            stage->connect(player, index, connector, sinkPad, this->m_queueSettings);
+        }
+        else
+        {
+            connector.connect(sinkPad, this->m_queueSettings, this->getRestrictionCaps(connector.getStreamType()),
+                              this->m_outputFile);
+        }
     });
 
-    // Configure codecs.
+    // Configure muxer and codecs.
     auto it = m_encodeBin->iterate_elements();
     while (it.next() == Gst::ITERATOR_OK)
     {
         auto factory = it->get_factory();
-        if (factory)
+        if (factory &&
+            static_cast<bool>(gst_element_factory_list_is_type(factory->gobj(), GST_ELEMENT_FACTORY_TYPE_MUXER)))
+        {
+            configureMuxer(*it);
+        }
+    }
+
+    const auto bus = player.getPipeline()->get_bus();
+    if (m_videoCodec)
+    {
+        configureCodecElements(*m_videoCodec, GST_STREAM_TYPE_VIDEO, m_encodeBin, bus);
+    }
+
+    if (m_audioCodec)
+    {
+        configureCodecElements(*m_audioCodec, GST_STREAM_TYPE_AUDIO, m_encodeBin, bus);
+    }
+}
+
+void Encoder::configureCodecElements(const Codec& codec, GstStreamType streamType, const Glib::RefPtr<Gst::Bin>& bin,
+                                     const Glib::RefPtr<Gst::Bus>& bus) noexcept
+{
+    const bool isVideo = (streamType == GST_STREAM_TYPE_VIDEO);
+    const GType encoderType = isVideo ? GST_TYPE_VIDEO_ENCODER : GST_TYPE_AUDIO_ENCODER;
+    auto it = bin->iterate_elements();
+    while (it.next() == Gst::ITERATOR_OK)
+    {
+        auto factory = it->get_factory();
+        if (factory && static_cast<bool>(g_type_is_a(factory->get_element_type(), encoderType)))
         {
-            if (m_videoCodec && static_cast<bool>(g_type_is_a(factory->get_element_type(), GST_TYPE_VIDEO_ENCODER)))
+            try
             {
-                try
-                {
-                    m_videoCodec->configureElement(factory->get_name(), *it);
-                }
-                catch (const std::exception& e)
-                {
-                    player.getPipeline()->get_bus()->post(Gst::MessageWarning::create(
-                        *it,
-                        Glib::Error(errorDomain, static_cast<int>(ErrorCode::cannotConfigureVideoCodec),
-                                    "cannot configure video codec"),
-                        e.what()));
-                }
+                codec.configureElement(factory->get_name(), *it);
             }
-            else if (m_audioCodec &&
-                     static_cast<bool>(g_type_is_a(factory->get_element_type(), GST_TYPE_AUDIO_ENCODER)))
+            catch (const std::exception& e)
             {
-                try
-                {
-                    m_audioCodec->configureElement(factory->get_name(), *it);
-                }
-                catch (const std::exception& e)
-                {
-                    player.getPipeline()->get_bus()->post(Gst::MessageWarning::create(
-                        *it,
-                        Glib::Error(errorDomain, static_cast<int>(ErrorCode::cannotConfigureAudioCodec),
-                                    "cannot configure audio codec"),
-                        e.what()));
-                }
+                const auto code = isVideo ? ErrorCode::cannotConfigureVideoCodec : ErrorCode::cannotConfigureAudioCodec;
+                bus->post(Gst::MessageWarning::create(
+                    *it,
+                    Glib::Error(errorDomain, static_cast<int>(code),
+                                isVideo ? "cannot configure video codec" : "cannot configure audio codec"),
+                    e.what()));
             }
         }
     }
 }
 
+void Encoder::configureMuxer(const Glib::RefPtr<Gst::Element>& muxer) const noexcept
+{
+    auto* muxerClass = G_OBJECT_GET_CLASS(muxer->gobj()); // NOLINT
+    if (isStreamed() && (g_object_class_find_property(muxerClass, "streamable") != nullptr))
+    {
+        g_object_set(muxer->gobj(), "streamable", TRUE, nullptr);
+    }
+}
+
+void Encoder::configureSink(const Glib::RefPtr<Gst::Element>& sink, guint64 expectedSize) const
+{
+    sink->set_property("location", m_outputFile);
+    g_object_set(sink->gobj(), "expected-size", expectedSize, "flush-on-key-units",
+                 static_cast<gboolean>(isStreamed()), nullptr);
+}
+
 void Encoder::onPlayerPlaying(Player& /*player*/) noexcept
 {
     // Empty method.
 }
 
-void Encoder::onPlayerStopped(Player& /*player*/, bool /*isInterrupted*/) noexcept
+void Encoder::onPlayerStopped(Player& player, bool isInterrupted) noexcept
 {
+    // An encoder may listen to several players, but only the one holding its
+    // elements matters.
+    if (!m_encodeBin->has_as_parent(player.getPipeline()))
+    {
+        return;
+    }
+
+    if (!isInterrupted && player.isRecyclingEnabled())
+    {
+        // Elements are kept in the READY pipeline for the next source, but
+        // must not be started with it before their output file is updated.
+        m_encodeBin->set_locked_state(true);
+        m_fileSink->set_locked_state(true);
+        for (const auto& stage : {m_videoStage, m_audioStage})
+        {
+            if (stage)
+            {
+                stage->setLocked(player.getPipeline(), true);
+            }
+        }
+        return;
+    }
+
     cleanupEncoder();
 }
 
@@ -274,6 +492,48 @@ Json Encoder::serialize() const
         obj[audioSampleRateKey] = m_audioSampleRate;
     }
 
+    Json queue = Json::object();
+    if (m_queueSettings.maxBuffers != QueueSettings::defaultValue)
+    {
+        queue[queueMaxBuffersKey] = m_queueSettings.maxBuffers;
+    }
+
+    if (m_queueSettings.maxBytes != QueueSettings::defaultValue)
+    {
+        queue[queueMaxBytesKey] = m_queueSettings.maxBytes;
+    }
+
+    if (m_queueSettings.maxTimeInMs != QueueSettings::defaultValue)
+    {
+        queue[queueMaxTimeKey] = m_queueSettings.maxTimeInMs;
+    }
+
+    if (m_queueSettings.leaky != QueueSettings::Leaky::defaultValue)
+    {
+        queue[queueLeakyKey] = m_queueSettings.leaky;
+    }
+
+    if (!queue.empty())
+    {
+        obj[queueKey] = std::move(queue);
+    }
+
+    Json tracks = Json::object();
+    if (!m_videoTracks.empty())
+    {
+        tracks[videoCodecKey] = serializeTracks(m_videoTracks);
+    }
+
+    if (!m_audioTracks.empty())
+    {
+        tracks[audioCodecKey] = serializeTracks(m_audioTracks);
+    }
+
+    if (!tracks.empty())
+    {
+        obj[tracksKey] = std::move(tracks);
+    }
+
     if (m_videoCodec)
     {
         obj[videoCodecKey] = m_videoCodec->serialize();
@@ -346,6 +606,50 @@ void Encoder::unserialize(const Json& in)
     }
     setAudioSampleRate(sampleRate);
 
+    QueueSettings queueSettings;
+    if (in.contains(queueKey))
+    {
+        const Json& entry = in.at(queueKey);
+        if (entry.contains(queueMaxBuffersKey))
+        {
+            queueSettings.maxBuffers = entry.at(queueMaxBuffersKey).get<int>();
+        }
+
+        if (entry.contains(queueMaxBytesKey))
+        {
+            queueSettings.maxBytes = entry.at(queueMaxBytesKey).get<int>();
+        }
+
+        if (entry.contains(queueMaxTimeKey))
+        {
+            queueSettings.maxTimeInMs = entry.at(queueMaxTimeKey).get<int>();
+        }
+
+        if (entry.contains(queueLeakyKey))
+        {
+            queueSettings.leaky = entry.at(queueLeakyKey).get<QueueSettings::Leaky>();
+        }
+    }
+    setQueueSettings(queueSettings);
+
+    TrackSelection videoTracks;
+    TrackSelection audioTracks;
+    if (in.contains(tracksKey))
+    {
+        const Json& entry = in.at(tracksKey);
+        if (entry.contains(videoCodecKey))
+        {
+            videoTracks = unserializeTracks(entry.at(videoCodecKey));
+        }
+
+        if (entry.contains(audioCodecKey))
+        {
+            audioTracks = unserializeTracks(entry.at(audioCodecKey));
+        }
+    }
+    setTrackSelection(GST_STREAM_TYPE_VIDEO, videoTracks);
+    setTrackSelection(GST_STREAM_TYPE_AUDIO, audioTracks);
+
     clearCodecs();
     if (in.contains(videoCodecKey))
     {
@@ -401,14 +705,61 @@ Glib::RefPtr<Gst::Caps> Encoder::getAudioCaps() const noexcept
     return Gst::Caps::create(data);
 }
 
-Glib::RefPtr<Gst::EncodingProfile> Encoder::createEncodingProfile() const
+Glib::RefPtr<Gst::Caps> Encoder::getPassthroughCaps(GstStreamType streamType) const
+{
+    const bool isVideo = (streamType & GST_STREAM_TYPE_VIDEO) != 0;
+    const auto& codec = isVideo ? m_videoCodec : m_audioCodec;
+    if (!codec || !codec->isPassthroughEnabled())
+    {
+        return Glib::RefPtr<Gst::Caps>();
+    }
+
+    // Streams can only be copied when they don't need any conversion. The
+    // profile of the codec mime type only constrains what encoders produce.
+    auto data = Gst::Structure::create_from_string(codec->getMimeType());
+    data.remove_field("profile");
+    if (isVideo)
+    {
+        if (m_videoWidth != sameAsSource)
+        {
+            data.set_field("width", m_videoWidth);
+        }
+
+        if (m_videoHeight != sameAsSource)
+        {
+            data.set_field("height", m_videoHeight);
+        }
+
+        if (m_frameRateNumerator != sameAsSource)
+        {
+            data.set_field("framerate", Gst::Fraction(m_frameRateNumerator, m_frameRateDenominator));
+        }
+    }
+    else
+    {
+        if (m_audioChannels != sameAsSource)
+        {
+            data.set_field("channels", m_audioChannels);
+        }
+
+        if (m_audioSampleRate != sameAsSource)
+        {
+            data.set_field("rate", m_audioSampleRate);
+        }
+    }
+
+    return Gst::Caps::create(data);
+}
+
+Glib::RefPtr<Gst::EncodingProfile> Encoder::createEncodingProfile(const Glib::RefPtr<Gst::Caps>& videoFormat,
+                                                                  const Glib::RefPtr<Gst::Caps>& audioFormat) const
 {
     auto caps = Gst::Caps::create_from_string(getMimeType());
     GstEncodingContainerProfile* profile = gst_encoding_container_profile_new(nullptr, nullptr, caps->gobj(), nullptr);
 
     if (m_videoCodec)
     {
-        caps = Gst::Caps::create_from_string(m_videoCodec->getMimeType());
+        caps = videoFormat ? videoFormat : Gst::Caps::create_from_string(m_videoCodec->getMimeType());
         if (!static_cast<bool>(gst_encoding_container_profile_add_profile(
                 profile, reinterpret_cast<GstEncodingProfile*>( // NOLINT
                              gst_encoding_video_profile_new(caps->gobj(), nullptr, getVideoCaps()->gobj(), 0)))))
@@ -419,7 +770,7 @@ Glib::RefPtr<Gst::EncodingProfile> Encoder::createEncodingProfile() const
 
     if (m_audioCodec)
     {
-        caps = Gst::Caps::create_from_string(m_audioCodec->getMimeType());
+        caps = audioFormat ? audioFormat : Gst::Caps::create_from_string(m_audioCodec->getMimeType());
         if (!static_cast<bool>(gst_encoding_container_profile_add_profile(
                 profile, reinterpret_cast<GstEncodingProfile*>( // NOLINT
                              gst_encoding_audio_profile_new(caps->gobj(), nullptr, getAudioCaps()->gobj(), 0)))))
@@ -431,8 +782,113 @@ Glib::RefPtr<Gst::EncodingProfile> Encoder::createEncodingProfile() const
     return Glib::wrap(reinterpret_cast<GstEncodingProfile*>(profile)); // NOLINT
 }
 
+bool Encoder::acceptsPassthrough(const Connector& connector) const
+{
+    auto caps = getPassthroughCaps(connector.getStreamType());
+    return caps && connector.getCaps()->can_intersect(caps);
+}
+
+bool Encoder::isSelected(const Connector& connector) const
+{
+    // Stream tags have been received by now, a track without language tag
+    // only matches indexes and stream-id patterns.
+    const auto& selection = getTrackSelection(connector.getStreamType());
+    return selection.empty() ||
+           selection.isSelected(connector.getTrackIndex(), connector.getStreamId(), connector.getLanguage().c_str());
+}
+
+guint64 Encoder::getExpectedSize(const Player& player) const noexcept
+{
+    // Output size from the nominal bitrates of the codecs, unknown as soon as
+    // one of them has none.
+    gint64 duration = 0;
+    if (!player.getPipeline()->query_duration(Gst::FORMAT_TIME, duration) || (duration <= 0))
+    {
+        return 0;
+    }
+
+    if (player.getEndTime() != Player::undefinedTime)
+    {
+        duration = std::min(duration, player.getEndTime());
+    }
+    if (player.getStartTime() != Player::undefinedTime)
+    {
+        duration -= player.getStartTime();
+    }
+
+    guint64 bitrateInKbps = 0;
+    for (const auto& codec : {m_videoCodec, m_audioCodec})
+    {
+        if (codec)
+        {
+            auto bitrateCodec = std::dynamic_pointer_cast<BitrateCodec>(codec);
+            if (!bitrateCodec || (bitrateCodec->getBitrate() <= 0))
+            {
+                return 0;
+            }
+            bitrateInKbps += static_cast<guint64>(bitrateCodec->getBitrate());
+        }
+    }
+
+    return (duration > 0) ? gst_util_uint64_scale(static_cast<guint64>(duration), bitrateInKbps * 1000 / 8, GST_SECOND)
+                          : 0;
+}
+
+void Encoder::setCodecFrameSize(const Glib::RefPtr<Gst::Caps>& sourceCaps) const noexcept
+{
+    auto codec = std::dynamic_pointer_cast<MultithreadedCodec>(m_videoCodec);
+    if (!codec)
+    {
+        return;
+    }
+
+    int width = 0;
+    int height = 0;
+    if (sourceCaps && (sourceCaps->size() > 0))
+    {
+        auto data = sourceCaps->get_structure(0);
+        data.get_field("width", width);
+        data.get_field("height", height);
+    }
+
+    // Output frame size, keeping source aspect ratio when only one dimension
+    // is specified.
+    if ((m_videoWidth != sameAsSource) && (m_videoHeight != sameAsSource))
+    {
+        width = m_videoWidth;
+        height = m_videoHeight;
+    }
+    else if ((m_videoWidth != sameAsSource) && (width > 0))
+    {
+        height = static_cast<int>(static_cast<gint64>(height) * m_videoWidth / width);
+        width = m_videoWidth;
+    }
+    else if ((m_videoHeight != sameAsSource) && (height > 0))
+    {
+        width = static_cast<int>(static_cast<gint64>(width) * m_videoHeight / height);
+        height = m_videoHeight;
+    }
+
+    codec->setFrameSize(width, height);
+}
+
 void Encoder::cleanupEncoder() noexcept
 {
+    // Shared stages elements are released with the first encoder using them.
+    auto pipeline = m_encodeBin->get_parent();
+    if (pipeline)
+    {
+        for (const auto& stage : {m_videoStage, m_audioStage})
+        {
+            if (stage)
+            {
+                stage->release(pipeline);
+            }
+        }
+    }
+
+    m_encodeBin->set_locked_state(false);
+    m_fileSink->set_locked_state(false);
     m_encodeBin->set_state(Gst::STATE_NULL);
     m_fileSink->set_state(Gst::STATE_NULL);
 
@@ -20,6 +20,7 @@
 
 #include "../codecs/Codec.h"
 #include "../player/IPlayerListener.h"
+#include "CodecStage.h"
 
 class Encoder : public IPlayerListener, public ISerializable
 {
@@ -32,8 +33,17 @@ class Encoder : public IPlayerListener, public ISerializable
     };
     static const GQuark errorDomain;
     static constexpr int sameAsSource = -1;
+    static constexpr const char* outputFileKey = "file";
+    static constexpr const char* videoCodecKey = "video";
+    static constexpr const char* audioCodecKey = "audio";
 
     static std::shared_ptr<Encoder> createEncoder(const std::string& type);
+    static std::string getFileExtension(const std::string& type);
+
+    // Configures the video or audio encoders of the bin with the codec
+    // settings, failures being posted as warnings on the bus.
+    static void configureCodecElements(const Codec& codec, GstStreamType streamType,
+                                       const Glib::RefPtr<Gst::Bin>& bin, const Glib::RefPtr<Gst::Bus>& bus) noexcept;
 
     Encoder();
     virtual ~Encoder() override;
@@ -45,6 +55,13 @@ class Encoder : public IPlayerListener, public ISerializable
 
     virtual const char* getType() const noexcept = 0;
     void setOutputFile(const Glib::ustring& file) noexcept;
+    const Glib::ustring& getOutputFile() const noexcept
+    {
+        return m_outputFile;
+    }
+
+    // Outputs written to the standard output ("-") can't be seeked back.
+    bool isStreamed() const noexcept;
 
     void setVideoDimensions(int width = sameAsSource, int height = sameAsSource) noexcept;
     void setVideoFrameRate(int numerator = sameAsSource, int denominator = 1) noexcept;
@@ -52,9 +69,42 @@ class Encoder : public IPlayerListener, public ISerializable
     void setAudioChannels(int n = sameAsSource) noexcept;
     void setAudioSampleRate(int rate = sameAsSource) noexcept;
 
+    void setQueueSettings(const QueueSettings& settings = QueueSettings()) noexcept;
+
+    // Source tracks encoded by this encoder (all of them by default).
+    void setTrackSelection(GstStreamType streamType, const TrackSelection& selection = TrackSelection());
+    const TrackSelection& getTrackSelection(GstStreamType streamType) const noexcept
+    {
+        return ((streamType & GST_STREAM_TYPE_VIDEO) != 0) ? m_videoTracks : m_audioTracks;
+    }
+
     void setVideoCodec(const std::shared_ptr<Codec>& codec);
     void setAudioCodec(const std::shared_ptr<Codec>& codec);
     void clearCodecs() noexcept;
+    const std::shared_ptr<Codec>& getVideoCodec() const noexcept
+    {
+        return m_videoCodec;
+    }
+    const std::shared_ptr<Codec>& getAudioCodec() const noexcept
+    {
+        return m_audioCodec;
+    }
+
+    // Encoders sharing a codec stage encode the stream only once.
+    void setCodecStage(GstStreamType streamType, const std::shared_ptr<CodecStage>& stage) noexcept;
+    const std::shared_ptr<CodecStage>& getCodecStage(GstStreamType streamType) const noexcept
+    {
+        return ((streamType & GST_STREAM_TYPE_VIDEO) != 0) ? m_videoStage : m_audioStage;
+    }
+
+    Glib::RefPtr<Gst::Caps> getRestrictionCaps(GstStreamType streamType) const noexcept;
+    Glib::RefPtr<Gst::Caps> getPassthroughCaps(GstStreamType streamType) const;
+    // Muxers of streamed outputs must write them sequentially.
+    virtual void configureMuxer(const Glib::RefPtr<Gst::Element>& muxer) const noexcept;
+    Glib::RefPtr<Gst::EncodingProfile> createEncodingProfile(
+        const Glib::RefPtr<Gst::Caps>& videoFormat = Glib::RefPtr<Gst::Caps>(),
+        const Glib::RefPtr<Gst::Caps>& audioFormat = Glib::RefPtr<Gst::Caps>()) const;
+    void cleanupEncoder() noexcept;
 
     void onPlayerPrerolled(Player& player) final;
     void onPlayerPlaying(Player& player) noexcept final;
@@ -66,15 +116,21 @@ class Encoder : public IPlayerListener, public ISerializable
     void unserialize(const Json& in) override;
 
   protected:
+    // Encoders writing something else than a single file provide their sink.
+    explicit Encoder(const Glib::RefPtr<Gst::Element>& sink);
+
     virtual const char* getMimeType() const noexcept = 0;
     virtual bool isVideoCodecAccepted(const char* codecType) const noexcept = 0;
     virtual bool isAudioCodecAccepted(const char* codecType) const noexcept = 0;
+    virtual void configureSink(const Glib::RefPtr<Gst::Element>& sink, guint64 expectedSize) const;
 
   private:
     Glib::RefPtr<Gst::EncodeBin> m_encodeBin;
-    Glib::RefPtr<Gst::FileSink> m_fileSink;
+    Glib::RefPtr<Gst::Element> m_fileSink;
     std::shared_ptr<Codec> m_videoCodec;
     std::shared_ptr<Codec> m_audioCodec;
+    std::shared_ptr<CodecStage> m_videoStage;
+    std::shared_ptr<CodecStage> m_audioStage;
 
     Glib::ustring m_outputFile;
 
@@ -87,7 +143,13 @@ class Encoder : public IPlayerListener, public ISerializable
     int m_audioChannels;
     int m_audioSampleRate;
     Glib::RefPtr<Gst::Caps> getAudioCaps() const noexcept;
+    void setCodecFrameSize(const Glib::RefPtr<Gst::Caps>& sourceCaps) const noexcept;
+    bool acceptsPassthrough(const Connector& connector) const;
+    bool isSelected(const Connector& connector) const;
+    guint64 getExpectedSize(const Player& player) const noexcept;
 
-    Glib::RefPtr<Gst::EncodingProfile> createEncodingProfile() const;
-    void cleanupEncoder() noexcept;
+    TrackSelection m_videoTracks;
+    TrackSelection m_audioTracks;
+
+    QueueSettings m_queueSettings;
 };
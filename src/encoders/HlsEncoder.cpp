@@ -0,0 +1,122 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "HlsEncoder.h"
+#include "../codecs/audio/AacCodec.h"
+#include "../codecs/audio/Mp3Codec.h"
+#include "../codecs/video/H264Codec.h"
+#include "../codecs/video/H265Codec.h"
+#include "../exceptions.h"
+#include <algorithm>
+#include <cstring>
+#include <glibmm/miscutils.h>
+
+namespace
+{
+constexpr const char* segmentDurationKey = "segmentduration";
+constexpr const char* playlistLengthKey = "playlistlength";
+} // namespace
+
+HlsEncoder::HlsEncoder()
+    : Encoder(Gst::ElementFactory::create_element("hlssink")), m_segmentDurationInSec(defaultSegmentDuration),
+      m_playlistLength(0)
+{
+    // Empty constructor.
+}
+
+void HlsEncoder::setSegmentDuration(int seconds) noexcept
+{
+    m_segmentDurationInSec = (seconds > 0) ? seconds : defaultSegmentDuration;
+}
+
+void HlsEncoder::setPlaylistLength(int n) noexcept
+{
+    m_playlistLength = std::max(n, 0);
+}
+
+Json HlsEncoder::serialize() const
+{
+    Json obj = Encoder::serialize();
+
+    if (m_segmentDurationInSec != defaultSegmentDuration)
+    {
+        obj[segmentDurationKey] = m_segmentDurationInSec;
+    }
+
+    if (m_playlistLength > 0)
+    {
+        obj[playlistLengthKey] = m_playlistLength;
+    }
+
+    return obj;
+}
+
+void HlsEncoder::unserialize(const Json& in)
+{
+    Encoder::unserialize(in);
+
+    int duration = defaultSegmentDuration;
+    if (in.contains(segmentDurationKey))
+    {
+        duration = in.at(segmentDurationKey).get<int>();
+    }
+    setSegmentDuration(duration);
+
+    int length = 0;
+    if (in.contains(playlistLengthKey))
+    {
+        length = in.at(playlistLengthKey).get<int>();
+    }
+    setPlaylistLength(length);
+}
+
+const char* HlsEncoder::getMimeType() const noexcept
+{
+    return "video/mpegts,systemstream=true,packetsize=188";
+}
+
+bool HlsEncoder::isVideoCodecAccepted(const char* codecType) const noexcept
+{
+    return ((std::strcmp(codecType, H264Codec::type) == 0) || (std::strcmp(codecType, H265Codec::type) == 0));
+}
+
+bool HlsEncoder::isAudioCodecAccepted(const char* codecType) const noexcept
+{
+    return ((std::strcmp(codecType, AacCodec::type) == 0) || (std::strcmp(codecType, Mp3Codec::type) == 0));
+}
+
+void HlsEncoder::configureSink(const Glib::RefPtr<Gst::Element>& sink, guint64 /*expectedSize*/) const
+{
+    if (isStreamed())
+    {
+        throw InvalidValueException();
+    }
+
+    // The playlist is replaced atomically each time a segment is complete,
+    // it never lists a segment still being written. Segments are listed
+    // relatively to the playlist directory.
+    const std::string playlist = getOutputFile();
+    auto name = Glib::path_get_basename(playlist);
+    name = name.substr(0, name.find_last_of('.'));
+    const auto segments = Glib::build_filename(Glib::path_get_dirname(playlist), name + "_%05d.ts");
+
+    const auto length = static_cast<guint>(m_playlistLength);
+    g_object_set(sink->gobj(), "playlist-location", playlist.c_str(), "location", segments.c_str(),
+                 "target-duration", static_cast<guint>(m_segmentDurationInSec), "playlist-length", length,
+                 "max-files", length, nullptr);
+}
@@ -0,0 +1,66 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "Encoder.h"
+
+// HTTP live streaming output: MPEG-TS segments listed by a playlist, the
+// output file. Segments are cut on key frames requested from the encoders
+// every segment duration, and are named after the playlist.
+class HlsEncoder final : public Encoder
+{
+  public:
+    static constexpr const char* type = "hls";
+
+    HlsEncoder();
+
+    const char* getType() const noexcept final
+    {
+        return HlsEncoder::type;
+    }
+
+    void setSegmentDuration(int seconds = defaultSegmentDuration) noexcept;
+    int getSegmentDuration() const noexcept
+    {
+        return m_segmentDurationInSec;
+    }
+
+    // Live playlists only list the last segments and remove the older ones
+    // (0 = all segments are kept, for video on demand).
+    void setPlaylistLength(int n = 0) noexcept;
+    int getPlaylistLength() const noexcept
+    {
+        return m_playlistLength;
+    }
+
+    Json serialize() const final;
+    void unserialize(const Json& in) final;
+
+  protected:
+    const char* getMimeType() const noexcept final;
+    bool isVideoCodecAccepted(const char* codecType) const noexcept final;
+    bool isAudioCodecAccepted(const char* codecType) const noexcept final;
+    void configureSink(const Glib::RefPtr<Gst::Element>& sink, guint64 expectedSize) const final;
+
+  private:
+    static constexpr int defaultSegmentDuration = 6;
+
+    int m_segmentDurationInSec;
+    int m_playlistLength;
+};
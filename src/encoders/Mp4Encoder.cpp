@@ -21,8 +21,25 @@
 #include "../codecs/audio/Mp3Codec.h"
 #include "../codecs/video/H264Codec.h"
 #include "../codecs/video/H265Codec.h"
+#include <algorithm>
 #include <cstring>
 
+namespace
+{
+constexpr const char* fragmentDurationKey = "fragmentduration";
+constexpr int streamedFragmentDurationInMs = 1000;
+} // namespace
+
+Mp4Encoder::Mp4Encoder() : m_fragmentDurationInMs(0)
+{
+    // Empty constructor.
+}
+
+void Mp4Encoder::setFragmentDuration(int ms) noexcept
+{
+    m_fragmentDurationInMs = std::max(ms, 0);
+}
+
 const char* Mp4Encoder::getMimeType() const noexcept
 {
     return "video/quicktime,variant=iso";
@@ -37,3 +54,55 @@ bool Mp4Encoder::isAudioCodecAccepted(const char* codecType) const noexcept
 {
     return ((std::strcmp(codecType, AacCodec::type) == 0) || (std::strcmp(codecType, Mp3Codec::type) == 0));
 }
+
+void Mp4Encoder::configureMuxer(const Glib::RefPtr<Gst::Element>& muxer) const noexcept
+{
+    // Without fragments, the header is written at the end and the size of
+    // the samples box rewritten at its start, streamed outputs are then
+    // always fragmented.
+    Encoder::configureMuxer(muxer);
+    int duration = m_fragmentDurationInMs;
+    if ((duration == 0) && isStreamed())
+    {
+        duration = streamedFragmentDurationInMs;
+    }
+
+    if (duration > 0)
+    {
+        g_object_set(muxer->gobj(), "fragment-duration", static_cast<guint>(duration), nullptr);
+    }
+}
+
+void Mp4Encoder::configureSink(const Glib::RefPtr<Gst::Element>& sink, guint64 expectedSize) const
+{
+    // Fragments are written as soon as they are complete.
+    Encoder::configureSink(sink, expectedSize);
+    if (m_fragmentDurationInMs > 0)
+    {
+        g_object_set(sink->gobj(), "flush-on-key-units", TRUE, nullptr);
+    }
+}
+
+Json Mp4Encoder::serialize() const
+{
+    Json obj = Encoder::serialize();
+
+    if (m_fragmentDurationInMs > 0)
+    {
+        obj[fragmentDurationKey] = m_fragmentDurationInMs;
+    }
+
+    return obj;
+}
+
+void Mp4Encoder::unserialize(const Json& in)
+{
+    Encoder::unserialize(in);
+
+    int duration = 0;
+    if (in.contains(fragmentDurationKey))
+    {
+        duration = in.at(fragmentDurationKey).get<int>();
+    }
+    setFragmentDuration(duration);
+}
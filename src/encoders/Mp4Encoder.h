@@ -25,13 +25,32 @@ class Mp4Encoder final : public Encoder
   public:
     static constexpr const char* type = "mp4";
 
+    Mp4Encoder();
+
     const char* getType() const noexcept final
     {
         return Mp4Encoder::type;
     }
 
+    // Fragmented outputs can be read while they are written (0 = not
+    // fragmented, but for streamed outputs).
+    void setFragmentDuration(int ms = 0) noexcept;
+    int getFragmentDuration() const noexcept
+    {
+        return m_fragmentDurationInMs;
+    }
+
+    void configureMuxer(const Glib::RefPtr<Gst::Element>& muxer) const noexcept final;
+
+    Json serialize() const final;
+    void unserialize(const Json& in) final;
+
   protected:
     const char* getMimeType() const noexcept final;
+    void configureSink(const Glib::RefPtr<Gst::Element>& sink, guint64 expectedSize) const final;
     bool isVideoCodecAccepted(const char* codecType) const noexcept final;
     bool isAudioCodecAccepted(const char* codecType) const noexcept final;
+
+  private:
+    int m_fragmentDurationInMs;
 };
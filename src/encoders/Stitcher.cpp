@@ -0,0 +1,201 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Stitcher.h"
+#include "../exceptions.h"
+#include "../io/FileReader.h"
+#include "../io/FileWriter.h"
+#include <iostream>
+
+namespace
+{
+Glib::RefPtr<Gst::Element> createConcat(const Glib::RefPtr<Gst::Pipeline>& pipeline,
+                                        const Glib::RefPtr<Gst::EncodeBin>& encodeBin, const char* padTemplate)
+{
+    auto concat = Gst::ElementFactory::create_element("concat");
+    if (!concat)
+    {
+        throw UnrecoverableError();
+    }
+
+    pipeline->add(concat);
+    if (concat->get_static_pad("src")->link(encodeBin->get_request_pad(padTemplate)) != Gst::PAD_LINK_OK)
+    {
+        throw CannotLinkPadException();
+    }
+
+    return concat;
+}
+
+void addParsedFile(const Glib::RefPtr<Gst::Pipeline>& pipeline, const std::string& file,
+                   const Glib::RefPtr<Gst::Pad>& videoPad, const Glib::RefPtr<Gst::Pad>& audioPad)
+{
+    auto fileSrc = FileReader::createSource();
+    auto parseBin = Gst::ElementFactory::create_element("parsebin");
+    if (!fileSrc || !parseBin)
+    {
+        throw UnrecoverableError();
+    }
+
+    fileSrc->set_property<Glib::ustring>("location", file);
+    pipeline->add(fileSrc)->add(parseBin);
+    fileSrc->link(parseBin);
+
+    parseBin->signal_pad_added().connect([videoPad, audioPad](const Glib::RefPtr<Gst::Pad>& pad) {
+        // WARNING: called from any streaming thread.
+        auto caps = pad->get_current_caps();
+        if (!caps)
+        {
+            return;
+        }
+
+        const std::string name = caps->get_structure(0).get_name();
+        Glib::RefPtr<Gst::Pad> sinkPad;
+        if (name.rfind("video/", 0) == 0)
+        {
+            sinkPad = videoPad;
+        }
+        else if (name.rfind("audio/", 0) == 0)
+        {
+            sinkPad = audioPad;
+        }
+
+        if (sinkPad && !sinkPad->is_linked())
+        {
+            pad->link(sinkPad);
+        }
+    });
+}
+} // namespace
+
+Stitcher::Stitcher(const Encoder& encoder, const std::vector<std::string>& partFiles, const std::string& audioFile,
+                   const std::string& outputFile)
+    : m_busWatchId(0)
+{
+    // Segments are parsed and remuxed without re-encoding: encodebin passes
+    // through encoded streams already matching its encoding profile. A concat
+    // element shifts each video segment after the previous one, so timestamps
+    // of the stitched output are continuous. Audio is encoded in one pass
+    // over the whole range and only remuxed alongside.
+    m_pipeline = Gst::Pipeline::create();
+    auto encodeBin = Gst::EncodeBin::create();
+    auto fileSink = FileWriter::createSink();
+
+    if (!m_pipeline || !encodeBin || !fileSink)
+    {
+        throw UnrecoverableError();
+    }
+
+    // Video parts are always encoded, but the audio may be passed through in
+    // the source format, which may be wider than what the codec encodes
+    // (another profile for instance).
+    encodeBin->property_profile() = encoder.createEncodingProfile(encoder.getPassthroughCaps(GST_STREAM_TYPE_VIDEO),
+                                                                  encoder.getPassthroughCaps(GST_STREAM_TYPE_AUDIO));
+    fileSink->set_property<Glib::ustring>("location", outputFile);
+
+    auto it = encodeBin->iterate_elements();
+    while (it.next() == Gst::ITERATOR_OK)
+    {
+        auto factory = it->get_factory();
+        if (factory &&
+            static_cast<bool>(gst_element_factory_list_is_type(factory->gobj(), GST_ELEMENT_FACTORY_TYPE_MUXER)))
+        {
+            encoder.configureMuxer(*it);
+        }
+    }
+    m_pipeline->add(encodeBin)->add(fileSink);
+    encodeBin->link(fileSink);
+
+    Glib::RefPtr<Gst::Element> videoConcat;
+    if (encoder.getVideoCodec())
+    {
+        videoConcat = createConcat(m_pipeline, encodeBin, "video_%u");
+    }
+
+    for (const auto& partFile : partFiles)
+    {
+        // Concat plays its sink pads in request order, so they must be
+        // requested now, in segment order, and not when parsebin pads appear.
+        Glib::RefPtr<Gst::Pad> videoPad;
+        if (videoConcat)
+        {
+            videoPad = videoConcat->get_request_pad("sink_%u");
+        }
+
+        addParsedFile(m_pipeline, partFile, videoPad, Glib::RefPtr<Gst::Pad>());
+    }
+
+    if (encoder.getAudioCodec() && !audioFile.empty())
+    {
+        addParsedFile(m_pipeline, audioFile, Glib::RefPtr<Gst::Pad>(), encodeBin->get_request_pad("audio_%u"));
+    }
+
+    m_busWatchId = m_pipeline->get_bus()->add_watch(sigc::mem_fun(*this, &Stitcher::onBusMessage));
+}
+
+Stitcher::~Stitcher()
+{
+    m_pipeline->set_state(Gst::STATE_NULL);
+    m_pipeline->get_bus()->remove_watch(m_busWatchId);
+}
+
+void Stitcher::start(const SlotDone& slot)
+{
+    m_slotDone = slot;
+    if (m_pipeline->set_state(Gst::STATE_PLAYING) == Gst::STATE_CHANGE_FAILURE)
+    {
+        throw InvalidStateException();
+    }
+}
+
+bool Stitcher::onBusMessage(const Glib::RefPtr<Gst::Bus>& /*bus*/, const Glib::RefPtr<Gst::Message>& message) noexcept
+{
+    switch (message->get_message_type())
+    {
+    case Gst::MESSAGE_EOS:
+        finish(true);
+        break;
+
+    case Gst::MESSAGE_ERROR: {
+        auto msgError = Glib::RefPtr<Gst::MessageError>::cast_static(message);
+        if (msgError)
+        {
+            std::cerr << "Stitching issue: " << msgError->parse_error().what()
+                      << " (Debug info: " << msgError->parse_debug() << ")" << std::endl;
+        }
+        finish(false);
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return true;
+}
+
+void Stitcher::finish(bool isSuccess) noexcept
+{
+    m_pipeline->set_state(Gst::STATE_NULL);
+    if (m_slotDone)
+    {
+        auto slot = std::move(m_slotDone);
+        m_slotDone = nullptr;
+        slot(isSuccess);
+    }
+}
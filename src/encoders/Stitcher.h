@@ -0,0 +1,47 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "Encoder.h"
+#include <functional>
+
+class Stitcher final
+{
+  public:
+    using SlotDone = std::function<void(bool isSuccess)>;
+
+    Stitcher(const Encoder& encoder, const std::vector<std::string>& partFiles, const std::string& audioFile,
+             const std::string& outputFile);
+    ~Stitcher();
+
+    Stitcher(const Stitcher&) = delete;
+    Stitcher& operator=(const Stitcher&) = delete;
+    Stitcher(Stitcher&&) = delete;
+    Stitcher& operator=(Stitcher&&) = delete;
+
+    void start(const SlotDone& slot);
+
+  private:
+    Glib::RefPtr<Gst::Pipeline> m_pipeline;
+    unsigned int m_busWatchId;
+    SlotDone m_slotDone;
+
+    bool onBusMessage(const Glib::RefPtr<Gst::Bus>& bus, const Glib::RefPtr<Gst::Message>& message) noexcept;
+    void finish(bool isSuccess) noexcept;
+};
@@ -91,3 +91,57 @@ class InvalidTypeException final : public std::exception
         return "invalid type";
     }
 };
+
+class InvalidValueException final : public std::exception
+{
+  public:
+    const char* what() const noexcept
+    {
+        return "invalid value";
+    }
+};
+
+class CannotSeekException final : public std::exception
+{
+  public:
+    const char* what() const noexcept
+    {
+        return "cannot seek";
+    }
+};
+
+class CannotProbeSourceException final : public std::exception
+{
+  public:
+    const char* what() const noexcept
+    {
+        return "cannot probe source";
+    }
+};
+
+class CannotOpenSocketException final : public std::exception
+{
+  public:
+    const char* what() const noexcept
+    {
+        return "cannot open socket";
+    }
+};
+
+class CannotWriteFileException final : public std::exception
+{
+  public:
+    const char* what() const noexcept
+    {
+        return "cannot write file";
+    }
+};
+
+class CannotReadFileException final : public std::exception
+{
+  public:
+    const char* what() const noexcept
+    {
+        return "cannot read file";
+    }
+};
@@ -0,0 +1,446 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FileReader.h"
+#include "../exceptions.h"
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr const char* sourceFactoryName = "dubbyfilereader";
+constexpr size_t defaultBlockSize = 1024 * 1024;
+constexpr size_t defaultReadAhead = 16 * 1024 * 1024;
+
+size_t blockSize = defaultBlockSize;
+size_t readAhead = defaultReadAhead;
+std::atomic<guint64> readBytes(0);
+std::atomic<gint64> stallTime(0);
+
+// Source element, reader is created when it starts and deleted when it stops.
+struct DubbyFileReaderSrc
+{
+    GstBaseSrc parent;
+    gchar* location;
+    FileReader* reader;
+};
+
+struct DubbyFileReaderSrcClass
+{
+    GstBaseSrcClass parentClass;
+};
+
+void initUriHandler(gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE(DubbyFileReaderSrc, dubby_file_reader_src, GST_TYPE_BASE_SRC, // NOLINT
+                        G_IMPLEMENT_INTERFACE(GST_TYPE_URI_HANDLER, initUriHandler))
+
+enum
+{
+    propLocation = 1
+};
+
+GstStaticPadTemplate srcTemplate = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, // NOLINT
+                                                           GST_STATIC_CAPS_ANY);
+
+DubbyFileReaderSrc* getSource(gpointer object) noexcept
+{
+    return reinterpret_cast<DubbyFileReaderSrc*>(object); // NOLINT
+}
+
+bool setLocation(DubbyFileReaderSrc* src, const gchar* location, GError** error) noexcept
+{
+    // The file can't change while it is read.
+    GST_OBJECT_LOCK(src);
+    const bool isOpen = (src->reader != nullptr);
+    if (!isOpen)
+    {
+        g_free(src->location);
+        src->location = g_strdup(location);
+    }
+    GST_OBJECT_UNLOCK(src);
+
+    if (isOpen)
+    {
+        g_set_error(error, GST_URI_ERROR, GST_URI_ERROR_BAD_STATE, "cannot change the location of an open file");
+    }
+    return !isOpen;
+}
+
+void setProperty(GObject* object, guint id, const GValue* value, GParamSpec* spec)
+{
+    if (id == propLocation)
+    {
+        setLocation(getSource(object), g_value_get_string(value), nullptr);
+    }
+    else
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec); // NOLINT
+    }
+}
+
+void getProperty(GObject* object, guint id, GValue* value, GParamSpec* spec)
+{
+    auto* src = getSource(object);
+    if (id == propLocation)
+    {
+        GST_OBJECT_LOCK(src);
+        g_value_set_string(value, src->location);
+        GST_OBJECT_UNLOCK(src);
+    }
+    else
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec); // NOLINT
+    }
+}
+
+void finalize(GObject* object)
+{
+    auto* src = getSource(object);
+    delete src->reader; // NOLINT
+    src->reader = nullptr;
+    g_free(src->location);
+    src->location = nullptr;
+
+    G_OBJECT_CLASS(dubby_file_reader_src_parent_class)->finalize(object); // NOLINT
+}
+
+gboolean onStart(GstBaseSrc* base)
+{
+    auto* src = getSource(base);
+    GST_OBJECT_LOCK(src);
+    const std::string location = (src->location != nullptr) ? src->location : "";
+    GST_OBJECT_UNLOCK(src);
+
+    try
+    {
+        auto* reader = new FileReader(location); // NOLINT
+        GST_OBJECT_LOCK(src);
+        src->reader = reader;
+        GST_OBJECT_UNLOCK(src);
+    }
+    catch (const std::exception& e)
+    {
+        GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, ("%s", e.what()), ("%s", location.c_str())); // NOLINT
+        return FALSE;
+    }
+
+    gst_base_src_set_blocksize(base, static_cast<guint>(blockSize));
+    return TRUE;
+}
+
+gboolean onStop(GstBaseSrc* base)
+{
+    auto* src = getSource(base);
+    GST_OBJECT_LOCK(src);
+    std::unique_ptr<FileReader> reader(src->reader);
+    src->reader = nullptr;
+    GST_OBJECT_UNLOCK(src);
+
+    return TRUE;
+}
+
+gboolean onGetSize(GstBaseSrc* base, guint64* size)
+{
+    auto* src = getSource(base);
+    if ((src->reader == nullptr) || !src->reader->isSeekable())
+    {
+        return FALSE;
+    }
+
+    *size = src->reader->getSize();
+    return TRUE;
+}
+
+gboolean onIsSeekable(GstBaseSrc* base)
+{
+    auto* src = getSource(base);
+    return static_cast<gboolean>((src->reader != nullptr) && src->reader->isSeekable());
+}
+
+GstFlowReturn onFill(GstBaseSrc* base, guint64 offset, guint length, GstBuffer* buffer)
+{
+    auto* src = getSource(base);
+    GstMapInfo info;
+    if (!static_cast<bool>(gst_buffer_map(buffer, &info, GST_MAP_WRITE)))
+    {
+        GST_ELEMENT_ERROR(src, RESOURCE, READ, ("cannot map buffer"), (nullptr)); // NOLINT
+        return GST_FLOW_ERROR;
+    }
+
+    size_t n = 0;
+    try
+    {
+        n = src->reader->read(info.data, length, offset);
+    }
+    catch (const std::exception& e)
+    {
+        gst_buffer_unmap(buffer, &info);
+        GST_ELEMENT_ERROR(src, RESOURCE, READ, ("%s", e.what()), (nullptr)); // NOLINT
+        return GST_FLOW_ERROR;
+    }
+    gst_buffer_unmap(buffer, &info);
+
+    if (n == 0)
+    {
+        return GST_FLOW_EOS;
+    }
+
+    gst_buffer_resize(buffer, 0, static_cast<gssize>(n));
+    GST_BUFFER_OFFSET(buffer) = offset;
+    GST_BUFFER_OFFSET_END(buffer) = offset + n;
+    return GST_FLOW_OK;
+}
+
+GstURIType getUriType(GType /*type*/)
+{
+    return GST_URI_SRC;
+}
+
+const gchar* const* getUriProtocols(GType /*type*/)
+{
+    static const gchar* const protocols[] = {"file", nullptr}; // NOLINT
+    return protocols;                                             // NOLINT
+}
+
+gchar* getUri(GstURIHandler* handler)
+{
+    auto* src = getSource(handler);
+    GST_OBJECT_LOCK(src);
+    gchar* uri = (src->location != nullptr) ? gst_filename_to_uri(src->location, nullptr) : nullptr;
+    GST_OBJECT_UNLOCK(src);
+    return uri;
+}
+
+gboolean setUri(GstURIHandler* handler, const gchar* uri, GError** error)
+{
+    gchar* location = g_filename_from_uri(uri, nullptr, nullptr);
+    if (location == nullptr)
+    {
+        g_set_error(error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI, "invalid file URI: %s", uri);
+        return FALSE;
+    }
+
+    const bool isSet = setLocation(getSource(handler), location, error);
+    g_free(location);
+    return static_cast<gboolean>(isSet);
+}
+
+void initUriHandler(gpointer iface, gpointer /*data*/)
+{
+    auto* handler = static_cast<GstURIHandlerInterface*>(iface);
+    handler->get_type = getUriType;
+    handler->get_protocols = getUriProtocols;
+    handler->get_uri = getUri;
+    handler->set_uri = setUri;
+}
+
+void dubby_file_reader_src_class_init(DubbyFileReaderSrcClass* klass)
+{
+    auto* objectClass = G_OBJECT_CLASS(klass); // NOLINT
+    objectClass->set_property = setProperty;
+    objectClass->get_property = getProperty;
+    objectClass->finalize = finalize;
+
+    g_object_class_install_property(
+        objectClass, propLocation,
+        g_param_spec_string("location", "File Location", "Location of the file to read", nullptr,
+                            static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    auto* elementClass = GST_ELEMENT_CLASS(klass); // NOLINT
+    gst_element_class_set_static_metadata(elementClass, "File reader", "Source/File",
+                                          "Read a local file in large blocks with read-ahead", "dubby-dub");
+    gst_element_class_add_static_pad_template(elementClass, &srcTemplate);
+
+    auto* baseSrcClass = GST_BASE_SRC_CLASS(klass); // NOLINT
+    baseSrcClass->start = onStart;
+    baseSrcClass->stop = onStop;
+    baseSrcClass->get_size = onGetSize;
+    baseSrcClass->is_seekable = onIsSeekable;
+    baseSrcClass->fill = onFill;
+}
+
+void dubby_file_reader_src_init(DubbyFileReaderSrc* src)
+{
+    src->location = nullptr;
+    src->reader = nullptr;
+}
+} // namespace
+
+void FileReader::setBlockSize(size_t size) noexcept
+{
+    blockSize = (size > 0) ? size : defaultBlockSize;
+}
+
+size_t FileReader::getBlockSize() noexcept
+{
+    return blockSize;
+}
+
+void FileReader::setReadAhead(size_t size) noexcept
+{
+    readAhead = size;
+}
+
+size_t FileReader::getReadAhead() noexcept
+{
+    return readAhead;
+}
+
+guint64 FileReader::getReadBytes() noexcept
+{
+    return readBytes;
+}
+
+gint64 FileReader::getStallTime() noexcept
+{
+    return stallTime;
+}
+
+void FileReader::printSummary()
+{
+    std::cout << "Sources read: " << std::fixed << std::setprecision(1)
+              << static_cast<double>(readBytes) / (1024. * 1024.) << " MiB, " << std::setprecision(2)
+              << static_cast<double>(stallTime) / G_USEC_PER_SEC << " s waiting for reads." << std::defaultfloat
+              << std::endl;
+}
+
+void FileReader::registerSource()
+{
+    // Ranked above filesrc (primary).
+    static const bool isRegistered = static_cast<bool>(
+        gst_element_register(nullptr, sourceFactoryName, GST_RANK_PRIMARY + 1, dubby_file_reader_src_get_type()));
+    if (!isRegistered)
+    {
+        throw UnrecoverableError();
+    }
+}
+
+Glib::RefPtr<Gst::Element> FileReader::createSource()
+{
+    registerSource();
+    auto src = Gst::ElementFactory::create_element(sourceFactoryName);
+    if (!src)
+    {
+        throw UnrecoverableError();
+    }
+
+    return src;
+}
+
+FileReader::FileReader(const std::string& file)
+    : m_fd(-1), m_isSeekable(false), m_size(0), m_readAhead(readAhead), m_adviseStart(0), m_adviseEnd(0)
+{
+    m_fd = open(file.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT
+    if (m_fd < 0)
+    {
+        throw CannotReadFileException();
+    }
+
+    struct stat info = {};
+    if (fstat(m_fd, &info) != 0)
+    {
+        ::close(m_fd);
+        throw CannotReadFileException();
+    }
+
+    // Pipes and devices (/dev/stdin for instance) are read as streams, with
+    // no size and no seeking.
+    m_isSeekable = S_ISREG(info.st_mode); // NOLINT
+    if (!m_isSeekable)
+    {
+        return;
+    }
+    m_size = static_cast<guint64>(info.st_size);
+
+    // Demuxers mostly read forward, doubling the kernel read-ahead window.
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+FileReader::~FileReader()
+{
+    ::close(m_fd);
+}
+
+size_t FileReader::read(guint8* data, size_t size, guint64 offset)
+{
+    if (m_isSeekable)
+    {
+        if (offset >= m_size)
+        {
+            return 0;
+        }
+
+        adviseReadAhead(offset, size);
+    }
+
+    // Streams are read sequentially, whatever the offset, and what is
+    // available is returned without waiting for a whole block.
+    size_t total = 0;
+    const gint64 start = g_get_monotonic_time();
+    while (total < size)
+    {
+        guint8* const end = data + total; // NOLINT
+        const ssize_t n = m_isSeekable ? pread(m_fd, end, size - total, static_cast<off_t>(offset + total))
+                                       : ::read(m_fd, end, size - total);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw CannotReadFileException();
+        }
+
+        if (n == 0)
+        {
+            break;
+        }
+        total += static_cast<size_t>(n);
+
+        if (!m_isSeekable)
+        {
+            break;
+        }
+    }
+    stallTime += g_get_monotonic_time() - start;
+    readBytes += total;
+
+    return total;
+}
+
+void FileReader::adviseReadAhead(guint64 offset, size_t size) noexcept
+{
+    // The next window is requested once half of the current one has been
+    // read, or as soon as the stream seeks out of it, so that reads are
+    // served from the page cache.
+    if ((m_readAhead == 0) || ((offset >= m_adviseStart) && (offset + size + m_readAhead / 2 <= m_adviseEnd)))
+    {
+        return;
+    }
+
+    m_adviseStart = offset;
+    m_adviseEnd = offset + size + m_readAhead;
+    posix_fadvise(m_fd, static_cast<off_t>(offset), static_cast<off_t>(size + m_readAhead), POSIX_FADV_WILLNEED);
+}
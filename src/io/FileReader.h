@@ -0,0 +1,78 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gstreamermm.h>
+#include <string>
+
+// Local source file read in large blocks, with the kernel reading ahead of
+// the stream. The source element registered by registerSource() outranks
+// filesrc, so uridecodebin picks it for all file:// URIs. Files which are not
+// regular files (pipes, devices) are read as non-seekable streams.
+class FileReader final
+{
+  public:
+    // Settings of the files opened afterwards.
+    static void setBlockSize(size_t size) noexcept;
+    static size_t getBlockSize() noexcept;
+    static void setReadAhead(size_t size) noexcept;
+    static size_t getReadAhead() noexcept;
+
+    // Bytes read from all the sources and time spent waiting for them (in µs).
+    static guint64 getReadBytes() noexcept;
+    static gint64 getStallTime() noexcept;
+    static void printSummary();
+
+    // GStreamer must be initialized.
+    static void registerSource();
+
+    // The source reads its "location" file (or file:// URI).
+    static Glib::RefPtr<Gst::Element> createSource();
+
+    explicit FileReader(const std::string& file);
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+    FileReader(FileReader&&) = delete;
+    FileReader& operator=(FileReader&&) = delete;
+
+    // Streams have no size.
+    bool isSeekable() const noexcept
+    {
+        return m_isSeekable;
+    }
+    guint64 getSize() const noexcept
+    {
+        return m_size;
+    }
+
+    // Returns the number of bytes read, 0 at end of file.
+    size_t read(guint8* data, size_t size, guint64 offset);
+
+  private:
+    int m_fd;
+    bool m_isSeekable;
+    guint64 m_size;
+    size_t m_readAhead;
+    guint64 m_adviseStart;
+    guint64 m_adviseEnd;
+
+    void adviseReadAhead(guint64 offset, size_t size) noexcept;
+};
@@ -0,0 +1,591 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FileWriter.h"
+#include "../exceptions.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+
+namespace
+{
+constexpr const char* sinkFactoryName = "dubbyfilewriter";
+constexpr size_t blockSize = 4096;
+constexpr size_t defaultBatchSize = 4 * 1024 * 1024;
+
+size_t batchSize = defaultBatchSize;
+bool isDirectIo = false;
+FileWriter::SyncPolicy syncPolicy = FileWriter::SyncPolicy::none;
+std::atomic<guint64> writtenBytes(0);
+std::atomic<gint64> writeTime(0);
+int standardOutputFd = STDOUT_FILENO;
+
+// Sink element, writer is created with the stream and deleted at its end.
+struct DubbyFileWriterSink
+{
+    GstBaseSink parent;
+    gchar* location;
+    guint64 expectedSize;
+    gboolean isFlushingOnKeyUnits;
+    FileWriter* writer;
+};
+
+struct DubbyFileWriterSinkClass
+{
+    GstBaseSinkClass parentClass;
+};
+
+G_DEFINE_TYPE(DubbyFileWriterSink, dubby_file_writer_sink, GST_TYPE_BASE_SINK) // NOLINT
+
+enum
+{
+    propLocation = 1,
+    propExpectedSize,
+    propFlushOnKeyUnits
+};
+
+GstStaticPadTemplate sinkTemplate = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, // NOLINT
+                                                            GST_STATIC_CAPS_ANY);
+
+DubbyFileWriterSink* getSink(gpointer object) noexcept
+{
+    return reinterpret_cast<DubbyFileWriterSink*>(object); // NOLINT
+}
+
+void postWriteError(DubbyFileWriterSink* sink, const std::exception& e) noexcept
+{
+    GST_OBJECT_LOCK(sink);
+    const std::string location = (sink->location != nullptr) ? sink->location : "";
+    GST_OBJECT_UNLOCK(sink);
+    GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("%s", e.what()), ("%s", location.c_str())); // NOLINT
+}
+
+FileWriter& getWriter(DubbyFileWriterSink* sink)
+{
+    if (sink->writer == nullptr)
+    {
+        GST_OBJECT_LOCK(sink);
+        const std::string location = (sink->location != nullptr) ? sink->location : "";
+        const guint64 expectedSize = sink->expectedSize;
+        GST_OBJECT_UNLOCK(sink);
+
+        sink->writer = new FileWriter(location, expectedSize); // NOLINT
+    }
+
+    return *sink->writer;
+}
+
+void closeWriter(DubbyFileWriterSink* sink)
+{
+    std::unique_ptr<FileWriter> writer(sink->writer);
+    sink->writer = nullptr;
+    if (writer)
+    {
+        writer->close();
+    }
+}
+
+void setProperty(GObject* object, guint id, const GValue* value, GParamSpec* spec)
+{
+    auto* sink = getSink(object);
+    GST_OBJECT_LOCK(sink);
+    switch (id)
+    {
+    case propLocation:
+        g_free(sink->location);
+        sink->location = g_value_dup_string(value);
+        break;
+
+    case propExpectedSize:
+        sink->expectedSize = g_value_get_uint64(value);
+        break;
+
+    case propFlushOnKeyUnits:
+        sink->isFlushingOnKeyUnits = g_value_get_boolean(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec); // NOLINT
+        break;
+    }
+    GST_OBJECT_UNLOCK(sink);
+}
+
+void getProperty(GObject* object, guint id, GValue* value, GParamSpec* spec)
+{
+    auto* sink = getSink(object);
+    GST_OBJECT_LOCK(sink);
+    switch (id)
+    {
+    case propLocation:
+        g_value_set_string(value, sink->location);
+        break;
+
+    case propExpectedSize:
+        g_value_set_uint64(value, sink->expectedSize);
+        break;
+
+    case propFlushOnKeyUnits:
+        g_value_set_boolean(value, sink->isFlushingOnKeyUnits);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec); // NOLINT
+        break;
+    }
+    GST_OBJECT_UNLOCK(sink);
+}
+
+void finalize(GObject* object)
+{
+    auto* sink = getSink(object);
+    delete sink->writer; // NOLINT
+    sink->writer = nullptr;
+    g_free(sink->location);
+    sink->location = nullptr;
+
+    G_OBJECT_CLASS(dubby_file_writer_sink_parent_class)->finalize(object); // NOLINT
+}
+
+gboolean onStop(GstBaseSink* base)
+{
+    auto* sink = getSink(base);
+    try
+    {
+        closeWriter(sink);
+    }
+    catch (const std::exception& e)
+    {
+        postWriteError(sink, e);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+GstFlowReturn onRender(GstBaseSink* base, GstBuffer* buffer)
+{
+    auto* sink = getSink(base);
+    GstMapInfo info;
+    if (!static_cast<bool>(gst_buffer_map(buffer, &info, GST_MAP_READ)))
+    {
+        GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("cannot map buffer"), (nullptr)); // NOLINT
+        return GST_FLOW_ERROR;
+    }
+
+    // Muxers start each fragment or cluster with a key unit, what precedes
+    // it is then complete and must not wait for the batch to be full.
+    GST_OBJECT_LOCK(sink);
+    const bool isFlushingOnKeyUnits = static_cast<bool>(sink->isFlushingOnKeyUnits);
+    GST_OBJECT_UNLOCK(sink);
+
+    try
+    {
+        auto& writer = getWriter(sink);
+        if (isFlushingOnKeyUnits && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) // NOLINT
+        {
+            writer.flush();
+        }
+        writer.write(info.data, info.size);
+    }
+    catch (const std::exception& e)
+    {
+        gst_buffer_unmap(buffer, &info);
+        postWriteError(sink, e);
+        return GST_FLOW_ERROR;
+    }
+
+    gst_buffer_unmap(buffer, &info);
+    return GST_FLOW_OK;
+}
+
+gboolean onEvent(GstBaseSink* base, GstEvent* event)
+{
+    // Muxers rewrite their headers with byte segments, and the file is
+    // complete once they forward the end of stream.
+    auto* sink = getSink(base);
+    try
+    {
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+        {
+            const GstSegment* segment = nullptr;
+            gst_event_parse_segment(event, &segment);
+            if (segment->format == GST_FORMAT_BYTES)
+            {
+                getWriter(sink).seek(segment->start);
+            }
+        }
+        else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS)
+        {
+            // Even an empty stream has its output file.
+            getWriter(sink);
+            closeWriter(sink);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        gst_event_unref(event);
+        postWriteError(sink, e);
+        return FALSE;
+    }
+
+    return GST_BASE_SINK_CLASS(dubby_file_writer_sink_parent_class)->event(base, event); // NOLINT
+}
+
+gboolean onQuery(GstBaseSink* base, GstQuery* query)
+{
+    GstFormat format = GST_FORMAT_UNDEFINED;
+    switch (GST_QUERY_TYPE(query))
+    {
+    case GST_QUERY_SEEKING:
+    {
+        // Muxers only write their outputs sequentially when they can't seek.
+        auto* sink = getSink(base);
+        GST_OBJECT_LOCK(sink);
+        const bool isPipe = (g_strcmp0(sink->location, FileWriter::standardOutput) == 0);
+        GST_OBJECT_UNLOCK(sink);
+
+        gst_query_parse_seeking(query, &format, nullptr, nullptr, nullptr);
+        gst_query_set_seeking(query, format, static_cast<gboolean>((format == GST_FORMAT_BYTES) && !isPipe), 0, -1);
+        return TRUE;
+    }
+
+    case GST_QUERY_FORMATS:
+        gst_query_set_formats(query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+        return TRUE;
+
+    default:
+        return GST_BASE_SINK_CLASS(dubby_file_writer_sink_parent_class)->query(base, query); // NOLINT
+    }
+}
+
+void dubby_file_writer_sink_class_init(DubbyFileWriterSinkClass* klass)
+{
+    auto* objectClass = G_OBJECT_CLASS(klass); // NOLINT
+    objectClass->set_property = setProperty;
+    objectClass->get_property = getProperty;
+    objectClass->finalize = finalize;
+
+    const auto flags = static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+    g_object_class_install_property(
+        objectClass, propLocation,
+        g_param_spec_string("location", "File Location", "Location of the file to write", nullptr, flags));
+    g_object_class_install_property(objectClass, propExpectedSize,
+                                    g_param_spec_uint64("expected-size", "Expected size",
+                                                        "Expected size of the file in bytes (0 = unknown)", 0,
+                                                        G_MAXUINT64, 0, flags));
+    g_object_class_install_property(objectClass, propFlushOnKeyUnits,
+                                    g_param_spec_boolean("flush-on-key-units", "Flush on key units",
+                                                         "Write the pending batch before each key unit", FALSE,
+                                                         flags));
+
+    auto* elementClass = GST_ELEMENT_CLASS(klass); // NOLINT
+    gst_element_class_set_static_metadata(elementClass, "File writer", "Sink/File",
+                                          "Write stream to a file in large aligned batches", "dubby-dub");
+    gst_element_class_add_static_pad_template(elementClass, &sinkTemplate);
+
+    auto* baseSinkClass = GST_BASE_SINK_CLASS(klass); // NOLINT
+    baseSinkClass->stop = onStop;
+    baseSinkClass->render = onRender;
+    baseSinkClass->event = onEvent;
+    baseSinkClass->query = onQuery;
+}
+
+void dubby_file_writer_sink_init(DubbyFileWriterSink* sink)
+{
+    sink->location = nullptr;
+    sink->expectedSize = 0;
+    sink->isFlushingOnKeyUnits = FALSE;
+    sink->writer = nullptr;
+
+    // Outputs are written as fast as they are produced.
+    gst_base_sink_set_sync(GST_BASE_SINK(sink), FALSE); // NOLINT
+}
+} // namespace
+
+void FileWriter::setBatchSize(size_t size) noexcept
+{
+    // Direct writes need whole blocks.
+    batchSize = (size > 0) ? ((size + blockSize - 1) / blockSize) * blockSize : defaultBatchSize;
+}
+
+size_t FileWriter::getBatchSize() noexcept
+{
+    return batchSize;
+}
+
+void FileWriter::setDirectIo(bool isEnabled) noexcept
+{
+    isDirectIo = isEnabled;
+}
+
+bool FileWriter::isDirectIoEnabled() noexcept
+{
+    return isDirectIo;
+}
+
+void FileWriter::setSyncPolicy(SyncPolicy policy) noexcept
+{
+    syncPolicy = policy;
+}
+
+FileWriter::SyncPolicy FileWriter::getSyncPolicy() noexcept
+{
+    return syncPolicy;
+}
+
+guint64 FileWriter::getWrittenBytes() noexcept
+{
+    return writtenBytes;
+}
+
+gint64 FileWriter::getWriteTime() noexcept
+{
+    return writeTime;
+}
+
+void FileWriter::printSummary()
+{
+    const double mib = static_cast<double>(writtenBytes) / (1024. * 1024.);
+    const double seconds = static_cast<double>(writeTime) / G_USEC_PER_SEC;
+    std::cout << "Outputs written: " << std::fixed << std::setprecision(1) << mib << " MiB in " << std::setprecision(2)
+              << seconds << " s of writes";
+    if (seconds > 0.)
+    {
+        std::cout << " (" << std::setprecision(1) << mib / seconds << " MiB/s)";
+    }
+    std::cout << "." << std::defaultfloat << std::endl;
+}
+
+void FileWriter::reserveStandardOutput()
+{
+    if (standardOutputFd != STDOUT_FILENO)
+    {
+        return;
+    }
+
+    std::cout.flush();
+    const int fd = dup(STDOUT_FILENO);
+    if ((fd < 0) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0))
+    {
+        throw UnrecoverableError();
+    }
+    standardOutputFd = fd;
+}
+
+Glib::RefPtr<Gst::Element> FileWriter::createSink()
+{
+    static const bool isRegistered = static_cast<bool>(
+        gst_element_register(nullptr, sinkFactoryName, GST_RANK_NONE, dubby_file_writer_sink_get_type()));
+
+    auto sink = isRegistered ? Gst::ElementFactory::create_element(sinkFactoryName) : Glib::RefPtr<Gst::Element>();
+    if (!sink)
+    {
+        throw UnrecoverableError();
+    }
+
+    return sink;
+}
+
+FileWriter::FileWriter(const std::string& file, guint64 expectedSize)
+    : m_fd(-1), m_isPipe(file == standardOutput), m_isDirect(false), m_batch(nullptr, std::free),
+      m_batchSize(batchSize), m_batchFill(0), m_batchOffset(0), m_position(0), m_fileSize(0), m_allocatedSize(0)
+{
+    void* batch = nullptr;
+    if (posix_memalign(&batch, blockSize, m_batchSize) != 0)
+    {
+        throw UnrecoverableError();
+    }
+    m_batch.reset(static_cast<guint8*>(batch));
+
+    if (m_isPipe)
+    {
+        m_fd = dup(standardOutputFd);
+        if (m_fd < 0)
+        {
+            throw CannotWriteFileException();
+        }
+        return;
+    }
+
+    // Direct I/O is not supported by all file systems.
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if (isDirectIo)
+    {
+        m_fd = open(file.c_str(), flags | O_DIRECT, 0666); // NOLINT
+        m_isDirect = (m_fd >= 0);
+    }
+
+    if (m_fd < 0)
+    {
+        m_fd = open(file.c_str(), flags, 0666); // NOLINT
+        if (m_fd < 0)
+        {
+            throw CannotWriteFileException();
+        }
+    }
+
+    // Reserving the whole file at once avoids its fragmentation between
+    // concurrent outputs, the file size only grows with the writes.
+    if ((expectedSize > 0) &&
+        (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(expectedSize)) == 0)) // NOLINT
+    {
+        m_allocatedSize = expectedSize;
+    }
+}
+
+FileWriter::~FileWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception&)
+    {
+        // Output is incomplete anyway.
+    }
+}
+
+void FileWriter::write(const guint8* data, size_t size)
+{
+    if (m_position != m_batchOffset + m_batchFill)
+    {
+        if (m_isPipe)
+        {
+            throw CannotSeekException();
+        }
+
+        flush();
+        m_batchOffset = m_position;
+    }
+
+    while (size > 0)
+    {
+        const size_t n = std::min(size, m_batchSize - m_batchFill);
+        std::memcpy(m_batch.get() + m_batchFill, data, n);
+        m_batchFill += n;
+        m_position += n;
+        data += n; // NOLINT
+        size -= n;
+
+        if (m_batchFill == m_batchSize)
+        {
+            flush();
+        }
+    }
+}
+
+void FileWriter::close()
+{
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    flush();
+
+    // Give back what has been preallocated beyond the end of the file.
+    if (m_allocatedSize > m_fileSize)
+    {
+        fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(m_fileSize), // NOLINT
+                  static_cast<off_t>(m_allocatedSize - m_fileSize));
+    }
+
+    const bool isSynced = (syncPolicy == SyncPolicy::none) || m_isPipe || (fsync(m_fd) == 0);
+    const int fd = m_fd;
+    m_fd = -1;
+    if ((::close(fd) != 0) || !isSynced)
+    {
+        throw CannotWriteFileException();
+    }
+}
+
+void FileWriter::flush()
+{
+    if (m_batchFill == 0)
+    {
+        return;
+    }
+
+    writeAt(m_batch.get(), m_batchFill, m_batchOffset);
+    m_batchOffset += m_batchFill;
+    m_batchFill = 0;
+
+    if ((syncPolicy == SyncPolicy::batch) && !m_isPipe && (fdatasync(m_fd) != 0))
+    {
+        throw CannotWriteFileException();
+    }
+}
+
+void FileWriter::writeAt(const guint8* data, size_t size, guint64 offset)
+{
+    // Only whole blocks at block boundaries are written directly, the end of
+    // the file and rewritten headers go through the page cache.
+    const bool isAligned = ((offset % blockSize) == 0) && ((size % blockSize) == 0);
+    if (m_isDirect && !isAligned)
+    {
+        setDirect(false);
+    }
+
+    const gint64 start = g_get_monotonic_time();
+    while (size > 0)
+    {
+        const ssize_t n =
+            m_isPipe ? ::write(m_fd, data, size) : pwrite(m_fd, data, size, static_cast<off_t>(offset));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (m_isDirect && !isAligned)
+            {
+                setDirect(true);
+            }
+            throw CannotWriteFileException();
+        }
+
+        data += n; // NOLINT
+        size -= static_cast<size_t>(n);
+        offset += static_cast<guint64>(n);
+        writtenBytes += static_cast<guint64>(n);
+    }
+    writeTime += g_get_monotonic_time() - start;
+    m_fileSize = std::max(m_fileSize, offset);
+
+    if (m_isDirect && !isAligned)
+    {
+        setDirect(true);
+    }
+}
+
+void FileWriter::setDirect(bool isEnabled) noexcept
+{
+    const int flags = fcntl(m_fd, F_GETFL); // NOLINT
+    if (flags >= 0)
+    {
+        fcntl(m_fd, F_SETFL, isEnabled ? (flags | O_DIRECT) : (flags & ~O_DIRECT)); // NOLINT
+    }
+}
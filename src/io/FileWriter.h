@@ -0,0 +1,96 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gstreamermm.h>
+#include <memory>
+#include <string>
+
+// Output file written in large block-aligned batches, preallocated from its
+// expected size. Muxers write it through the sink element created by
+// createSink(), in place of a filesink.
+class FileWriter final
+{
+  public:
+    // Location of the standard output, which can only be written sequentially.
+    static constexpr const char* standardOutput = "-";
+
+    enum class SyncPolicy
+    {
+        none,
+        close,
+        batch
+    };
+
+    // Settings of the files opened afterwards.
+    static void setBatchSize(size_t size) noexcept;
+    static size_t getBatchSize() noexcept;
+    static void setDirectIo(bool isEnabled) noexcept;
+    static bool isDirectIoEnabled() noexcept;
+    static void setSyncPolicy(SyncPolicy policy) noexcept;
+    static SyncPolicy getSyncPolicy() noexcept;
+
+    // Bytes written by all the outputs and time spent writing them (in µs).
+    static guint64 getWrittenBytes() noexcept;
+    static gint64 getWriteTime() noexcept;
+    static void printSummary();
+
+    // Keeps the standard output for the outputs written to it, console
+    // messages being redirected to the standard error.
+    static void reserveStandardOutput();
+
+    // The sink writes to its "location" file, preallocating its
+    // "expected-size" bytes (0 = unknown). The file is opened with the
+    // stream and closed at its end, so the location can change between
+    // streams without any state change. Outputs read while they are written
+    // set "flush-on-key-units", so that each complete fragment is written
+    // without waiting for a full batch.
+    static Glib::RefPtr<Gst::Element> createSink();
+
+    FileWriter(const std::string& file, guint64 expectedSize);
+    ~FileWriter();
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+    FileWriter(FileWriter&&) = delete;
+    FileWriter& operator=(FileWriter&&) = delete;
+
+    void write(const guint8* data, size_t size);
+    void seek(guint64 offset) noexcept
+    {
+        m_position = offset;
+    }
+    void flush();
+    void close();
+
+  private:
+    int m_fd;
+    bool m_isPipe;
+    bool m_isDirect;
+    std::unique_ptr<guint8[], void (*)(void*)> m_batch; // NOLINT
+    size_t m_batchSize;
+    size_t m_batchFill;
+    guint64 m_batchOffset;
+    guint64 m_position;
+    guint64 m_fileSize;
+    guint64 m_allocatedSize;
+
+    void writeAt(const guint8* data, size_t size, guint64 offset);
+    void setDirect(bool isEnabled) noexcept;
+};
@@ -16,7 +16,14 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include "Transcoder.h"
+#include "Daemon.h"
+#include "ResourceDiscovery.h"
+#include "TranscoderPool.h"
+#include "exceptions.h"
+#include "io/FileReader.h"
+#include "io/FileWriter.h"
+#include "player/Connector.h"
+#include <algorithm>
 #include <cstdio>
 #include <fstream>
 #include <glibmm.h>
@@ -27,6 +34,7 @@ extern const char* dubbyDubVersion;
 
 namespace
 {
+constexpr const char* standardInputUri = "fd://0";
 constexpr const char* help = R"(
 Usage:
   dubby-dub [options] [File...]...[URI...]
@@ -48,24 +56,126 @@ Usage:
                            source media, you should specify an output directory
                            in order to not override output files from previous
                            transcoding.
+    -j/--jobs [N]:         transcode up to [N] source media in parallel
+                           (default is 1, use 0 to run one job per available
+                           CPU core, within CPU affinity, container CPU quota
+                           and available memory limits). Decoders and encoders
+                           threads of each job are sized from the available
+                           CPUs shared between jobs. Parallel jobs require an
+                           output directory (provided with -o [Dir]),
+                           otherwise sources are transcoded sequentially.
+    -s/--segments [N]:     split each source media into [N] segments which
+                           are transcoded in parallel (see -j option) and
+                           stitched back together without re-encoding (only
+                           the video is split, sources with an encoder
+                           without video or passing it through are not).
+    --segment-duration [S]:
+                           split each source media into segments of [S]
+                           seconds (if -s is also specified, [N] is then
+                           the maximum number of segments).
+    -r/--reuse:            reuse pipelines and encoders from one source media
+                           to the next one when they have exactly the same
+                           streams, instead of rebuilding them from scratch.
+    -l/--lookahead:        preroll the next source media while the current one
+                           is still being transcoded, so that transcoding of
+                           the next one starts as soon as the current one is
+                           done (hides sources opening and demuxing setup
+                           delays, in particular for remote URIs).
+    -t/--max-threads [N]:  limit the number of threads used by all jobs to
+                           about [N]: decoders and encoders of each job get an
+                           equal share of [N] threads instead of the available
+                           CPUs, and new jobs wait for running ones
+                           to release streaming threads rather than going
+                           over [N] (0 = no limit, default). Peak number of
+                           streaming threads is reported at the end.
+    --dump-stages:         print, for each source media, its streams and the
+                           outputs fed by each of them, directly or through
+                           a conversion stage shared by all the outputs with
+                           the same dimensions and frame rate (or channels
+                           and sample rate).
+    --max-cascade-ratio [R]:
+                           video renditions of different dimensions are scaled
+                           from the nearest larger rendition of the same frame
+                           rate instead of all from the source, but only when
+                           it is at most [R] times larger (e.g. 2 to derive
+                           720p from 1080p and 360p from 720p, but not 480p
+                           from 1080p). 0 disables cascading (scaling from
+                           the source gives the best quality), default has
+                           no limit.
+    --cache-dir [Dir]:     keep the transcoded outputs in the [Dir] cache,
+                           indexed by a hash of the source content and
+                           modification time, of the transcoder
+                           configuration and of the installed
+                           GStreamer plugins versions: transcoding the same
+                           local source again with the same configuration
+                           then just copies the cached outputs.
+                           Hits and misses are reported at the end.
+    --cache-size [MiB]:    maximum size of the outputs cache, least recently
+                           used outputs are evicted first (0 = unlimited,
+                           default).
+    --read-block [KiB]:    local source files are read in blocks of [KiB]
+                           (default 1024) by their demuxers when they pull
+                           data, or by the source when it pushes data.
+    --read-ahead [MiB]:    ask the system to read [MiB] ahead of what is
+                           being read in local source files (default 16,
+                           0 leaves read-ahead to the system). Bytes read and
+                           time spent waiting for them are reported at the
+                           end.
+    --write-batch [KiB]:   outputs are written in batches of [KiB] (rounded
+                           up to 4 KiB blocks, default 4096), their files
+                           being preallocated from the bitrates of their
+                           codecs when known. Write throughput is reported
+                           at the end.
+    --direct-io:           write output batches with direct I/O, bypassing
+                           the page cache (when the file system supports
+                           it).
+    --sync [Policy]:       flush outputs to disk on "close", after each
+                           "batch", or leave it to the system ("none",
+                           default).
+    -d/--daemon [Socket]:  run as a daemon listening for transcoding jobs on
+                           the [Socket] unix domain socket instead of
+                           transcoding the specified source media (see below
+                           for daemon protocol). The transcoder configuration
+                           is then optional and provides the defaults of the
+                           settings jobs don't override.
     -h or --help:          displays this help content and exits.
     -v or --version:       displays version and exits.
 
   [File...]...[URI...]:    a list of source media files (paths can be relative
                            to current working directory) and/or URIs. All
-                           specified media will be transcoded sequencially one
-                           after the other using the same transcoding
-                           configuration.
+                           specified media will be transcoded using the same
+                           transcoding configuration, sequencially one after
+                           the other or in parallel (see -j option). "-"
+                           reads the source media from the standard input
+                           (it is then never split into segments).
 
   Configuration format (json):
   {
     "type": "transcoder",    --> compulsory to identify the configuration
+    "start": 2400,           --> (optional) only transcode sources from this
+                                 time in seconds, media before it is skipped
+                                 by seeking instead of being decoded
+    "end": 3300,             --> (optional) only transcode sources up to this
+                                 time in seconds
+    "seek": "accurate",      --> (optional) seek mode for start time
+                                 (accurate|keyframe), accurate starts exactly
+                                 at start time, keyframe starts at the
+                                 previous key frame without decoding anything
+                                 before it (faster, default is accurate,
+                                 segments are always accurate)
     "encoders": [            --> list of encoders (one entry per transcoded
-    {                            output), there must be at least one encoder
-      "type": "webm",        --> encoder type (mkv|mp4|ogg|webm) (see below
-                                 for codecs compatibility)
+    {                            output), there must be at least one encoder,
+                                 encoders with identical video (or audio)
+                                 codec settings and output dimensions (or
+                                 channels and sample rate) encode the stream
+                                 only once for all of them
+      "type": "webm",        --> encoder type (hls|mkv|mp4|ogg|webm) (see
+                                 below for codecs compatibility)
       "file": "./out.webm",  --> (optional) transcoded file output path, can
-                                 be overridden by -o option
+                                 be overridden by -o option, "-" writes the
+                                 output to the standard output (console
+                                 messages then go to the standard error) with
+                                 streamable muxer settings (fragmented mp4)
       "width": 1920,         --> (optional) output width (set <= 0 or nothing
                                  to keep input media width)
       "height": 1080,        --> (optional) output height (set <= 0 or nothing
@@ -79,24 +189,94 @@ Usage:
                                  number of channels)
       "samplerate": 44100,   --> (optional) output audio sample rate (set <= 0
                                  or nothing to keep input media sample rate)
+      "fragmentduration": 2000,
+                             --> (optional) ONLY FOR mp4: write a fragmented
+                                 mp4 with fragments of this duration in ms,
+                                 which can be read while it is being written
+                                 (0 or nothing = not fragmented, outputs
+                                 written to the standard output always use
+                                 fragments, of 1000 ms by default)
+      "segmentduration": 6,  --> (optional) ONLY FOR hls: target duration of
+                                 the MPEG-TS segments in seconds (default is
+                                 6), the output file is the playlist and
+                                 segments are written next to it, named
+                                 after it (segments are cut on key frames
+                                 requested from the encoders, passthrough
+                                 video is not split)
+      "playlistlength": 5,   --> (optional) ONLY FOR hls: number of segments
+                                 listed by a live playlist, older segments
+                                 being deleted (0 or nothing = all segments
+                                 are kept, for video on demand)
+      "queue": {             --> (optional) settings of the queue decoupling
+                                 this output from the other ones, each output
+                                 runs in its own streaming thread
+        "buffers": 200,      --> (optional) maximum number of buffers in queue
+                                 (0 = unlimited, default is 200)
+        "bytes": 10485760,   --> (optional) maximum size of queued data in
+                                 bytes (0 = unlimited, default is 10 MiB)
+        "time": 1000,        --> (optional) maximum duration of queued data in
+                                 ms (0 = unlimited, default is 1000 ms)
+        "leaky": "no"        --> (optional) drop policy when queue is full
+                                 (no|upstream|downstream), use downstream for
+                                 live sources to drop the oldest buffers
+                                 instead of blocking the other outputs
+      },
+      "tracks": {            --> (optional) source tracks to transcode when
+                                 the source has several video (or audio)
+                                 tracks, all of them if not specified (tracks
+                                 no encoder selects are not decoded)
+        "video": [0],        --> (optional) list of video tracks, by index
+                                 (among the video tracks of the source)
+        "audio": ["eng", 2]  --> (optional) list of audio tracks, by index,
+                                 language tag (as found in the source, e.g.
+                                 en or eng) or stream-id pattern (with * and
+                                 ? wildcards)
+      },
       "video": {             --> (optional) output video codec, if not
                                  specified video will not be transcoded
         "type": "vp9",       --> video codec type (h264|h265|theora|vp8|vp9)
                                  (see below for codecs compatibility)
+        "passthrough": true, --> (optional) copy the source video stream
+                                 without re-encoding it when it is already
+                                 encoded with this codec and has the output
+                                 width, height and frame rate (only if all
+                                 encoders with a video codec accept it),
+                                 default is false (available for all codecs)
         "mode": "bitrate",   --> (optional) encoding mode (bitrate|quality),
                                  if not specified default mode is bitrate
         "bitrate": 2500,     --> (optional) encoding bitrate in kbps (only used
                                  if mode is bitrate), if negative or not
                                  specified default bitrate is 2048 kbps
-        "quality": 75        --> (optional) encoding quality in percent
+        "speed": 50,         --> (optional) encoding speed in percent, from 0
+                                 (slowest, best compression) to 100 (fastest),
+                                 or one of the slowest|slow|medium|fast|fastest
+                                 presets, if negative or not specified encoder
+                                 default speed is used (available for all
+                                 codecs but aac and vorbis, and vaapi vp8/vp9)
+        "quality": 75,       --> (optional) encoding quality in percent
                                  (between 0 and 100, only used if mode is
                                  quality), if negative or not specified
                                  default quality depends on codec
+        "threads": 8,        --> (optional) ONLY FOR h264, h265, vp8 and vp9:
+                                 number of encoding threads, if <= 0 or not
+                                 specified it depends on output resolution
+                                 (up to the number of CPU cores)
+        "slicedthreads": false, --> (optional) ONLY FOR h264: use sliced
+                                 threads (lower latency but lower quality)
+        "tilecolumns": 2,    --> (optional) ONLY FOR vp9: log2 of the number
+                                 of tile columns, if negative or not
+                                 specified it depends on output width and
+                                 number of threads
+        "rowmt": true        --> (optional) ONLY FOR vp9: enable row based
+                                 multithreading (default is true)
       },
       "audio": {             --> (optional) output audio codec, if not
                                  specified audio will not be transcoded
         "type": "vorbis",    --> audio codec type (aac|mp3|opus|vorbis)
                                  (see below for codecs compatibility)
+        "passthrough": true, --> (optional) same as for video, the source
+                                 audio stream must have the output number of
+                                 channels and sample rate
         "mode": "quality",   --> (optional) ONLY FOR mp3 and vorbis: encoding
                                  mode (bitrate|quality), if not specified
                                  default mode is quality
@@ -113,21 +293,35 @@ Usage:
   }
 
   Codecs compatibility:
-    /-----------------------------------------\
-    | Encoder |  mkv  |  mp4  |  ogg  |  webm |
-    |  Codec  |       |       |       |       |
-    -------------------------------------------
-    |  h264   |   X   |   X   |       |       |
-    |  h265   |   X   |   X   |       |       |
-    | theora  |   X   |       |   X   |       |
-    |   vp8   |   X   |       |       |   X   |
-    |   vp9   |   X   |       |       |   X   |
-    -------------------------------------------
-    |   aac   |   X   |   X   |       |       |
-    |   mp3   |   X   |   X   |       |       |
-    |   opus  |   X   |       |   X   |   X   |
-    | vorbis  |   X   |       |   X   |   X   |
-    \-----------------------------------------/
+    /-------------------------------------------------\
+    | Encoder |  hls  |  mkv  |  mp4  |  ogg  |  webm |
+    |  Codec  |       |       |       |       |       |
+    ---------------------------------------------------
+    |  h264   |   X   |   X   |   X   |       |       |
+    |  h265   |   X   |   X   |   X   |       |       |
+    | theora  |       |   X   |       |   X   |       |
+    |   vp8   |       |   X   |       |       |   X   |
+    |   vp9   |       |   X   |       |       |   X   |
+    ---------------------------------------------------
+    |   aac   |   X   |   X   |   X   |       |       |
+    |   mp3   |   X   |   X   |   X   |       |       |
+    |   opus  |       |   X   |       |   X   |   X   |
+    | vorbis  |       |   X   |       |   X   |   X   |
+    \-------------------------------------------------/
+
+  Daemon protocol:
+    Each job is sent as one json object per line, using the configuration
+    format above, its entries replacing the ones of the daemon configuration
+    (a null entry removes it), with two extra entries:
+    - "sources": ["/path/to/file", "URI"...] (compulsory), list of absolute
+      source media paths and/or URIs to transcode,
+    - "outputdir": "/path/to/dir" (optional), output directory overriding
+      output paths from configuration (default is -o option if specified).
+    For each source, the daemon sends back json events, one per line:
+    - {"event": "accepted", "id": 1, "source": "URI"} when queued,
+    - {"event": "progress", "id": 1, "progress": 0.42} every 500 ms,
+    - {"event": "finished", "id": 1, "source": "URI", "success": true},
+    - {"event": "error", "message": "..."} if the job is invalid.
 
   Application controls:
     At any moment you can press:
@@ -146,7 +340,23 @@ struct Config
 {
     Json transcoderConfig;
     std::string outputPath;
+    std::string daemonSocket;
+    std::string cacheDir;
     std::vector<Glib::ustring> sourceUris;
+    unsigned int jobs = 1;
+    unsigned int segmentCount = 0;
+    unsigned int segmentDuration = 0;
+    unsigned int maxThreads = 0;
+    unsigned int cacheSizeInMiB = 0;
+    unsigned int readBlockInKiB = 0;
+    int readAheadInMiB = -1;
+    unsigned int writeBatchInKiB = 0;
+    FileWriter::SyncPolicy syncPolicy = FileWriter::SyncPolicy::none;
+    double maxCascadeRatio = -1.;
+    bool isRecyclingEnabled = false;
+    bool isLookaheadEnabled = false;
+    bool isStageDumpEnabled = false;
+    bool isDirectIoEnabled = false;
     bool mustExit = false;
 };
 
@@ -160,12 +370,29 @@ void printVersion()
     std::cout << "dubby-dub version: " << dubbyDubVersion << std::endl;
 }
 
+size_t getStandardOutputCount(const Json& transcoderConfig)
+{
+    if (!transcoderConfig.contains(Transcoder::encodersKey))
+    {
+        return 0;
+    }
+
+    const auto& encoders = transcoderConfig.at(Transcoder::encodersKey);
+    return static_cast<size_t>(std::count_if(encoders.begin(), encoders.end(), [](const Json& entry) {
+        return entry.value(Encoder::outputFileKey, "") == FileWriter::standardOutput;
+    }));
+}
+
 Config parseConfig(int argc, char** argv)
 {
     Config cfg;
     for (int i = 1; i < argc; ++i)
     {
-        if (argv[i][0] == '-') // NOLINT
+        if (strcmp(argv[i], "-") == 0) // NOLINT
+        {
+            cfg.sourceUris.emplace_back(standardInputUri);
+        }
+        else if (argv[i][0] == '-') // NOLINT
         {
             if (strcmp(argv[i], "--") == 0) // NOLINT
             {
@@ -194,6 +421,83 @@ Config parseConfig(int argc, char** argv)
             {
                 cfg.outputPath = argv[i]; // NOLINT
             }
+            else if ((strcmp(argv[i], "-r") == 0) || (strcmp(argv[i], "--reuse") == 0)) // NOLINT
+            {
+                cfg.isRecyclingEnabled = true;
+            }
+            else if ((strcmp(argv[i], "-l") == 0) || (strcmp(argv[i], "--lookahead") == 0)) // NOLINT
+            {
+                cfg.isLookaheadEnabled = true;
+            }
+            else if (strcmp(argv[i], "--dump-stages") == 0) // NOLINT
+            {
+                cfg.isStageDumpEnabled = true;
+            }
+            else if ((strcmp(argv[i], "--max-cascade-ratio") == 0) && (++i < argc)) // NOLINT
+            {
+                cfg.maxCascadeRatio = std::max(std::stod(argv[i]), 0.); // NOLINT
+            }
+            else if (((strcmp(argv[i], "-t") == 0) || (strcmp(argv[i], "--max-threads") == 0)) && // NOLINT
+                     (++i < argc))
+            {
+                cfg.maxThreads = static_cast<unsigned int>(std::max(std::stoi(argv[i]), 0)); // NOLINT
+            }
+            else if ((strcmp(argv[i], "--cache-dir") == 0) && (++i < argc)) // NOLINT
+            {
+                cfg.cacheDir = argv[i]; // NOLINT
+            }
+            else if ((strcmp(argv[i], "--cache-size") == 0) && (++i < argc)) // NOLINT
+            {
+                cfg.cacheSizeInMiB = static_cast<unsigned int>(std::max(std::stoi(argv[i]), 0)); // NOLINT
+            }
+            else if ((strcmp(argv[i], "--read-block") == 0) && (++i < argc)) // NOLINT
+            {
+                cfg.readBlockInKiB = static_cast<unsigned int>(std::max(std::stoi(argv[i]), 0)); // NOLINT
+            }
+            else if ((strcmp(argv[i], "--read-ahead") == 0) && (++i < argc)) // NOLINT
+            {
+                cfg.readAheadInMiB = std::max(std::stoi(argv[i]), 0); // NOLINT
+            }
+            else if ((strcmp(argv[i], "--write-batch") == 0) && (++i < argc)) // NOLINT
+            {
+                cfg.writeBatchInKiB = static_cast<unsigned int>(std::max(std::stoi(argv[i]), 0)); // NOLINT
+            }
+            else if (strcmp(argv[i], "--direct-io") == 0) // NOLINT
+            {
+                cfg.isDirectIoEnabled = true;
+            }
+            else if ((strcmp(argv[i], "--sync") == 0) && (++i < argc)) // NOLINT
+            {
+                if (strcmp(argv[i], "close") == 0) // NOLINT
+                {
+                    cfg.syncPolicy = FileWriter::SyncPolicy::close;
+                }
+                else if (strcmp(argv[i], "batch") == 0) // NOLINT
+                {
+                    cfg.syncPolicy = FileWriter::SyncPolicy::batch;
+                }
+                else
+                {
+                    cfg.syncPolicy = FileWriter::SyncPolicy::none;
+                }
+            }
+            else if (((strcmp(argv[i], "-d") == 0) || (strcmp(argv[i], "--daemon") == 0)) && (++i < argc)) // NOLINT
+            {
+                cfg.daemonSocket = argv[i]; // NOLINT
+            }
+            else if (((strcmp(argv[i], "-j") == 0) || (strcmp(argv[i], "--jobs") == 0)) && (++i < argc)) // NOLINT
+            {
+                const int jobs = std::stoi(argv[i]); // NOLINT
+                cfg.jobs = (jobs > 0) ? static_cast<unsigned int>(jobs) : 0;
+            }
+            else if (((strcmp(argv[i], "-s") == 0) || (strcmp(argv[i], "--segments") == 0)) && (++i < argc)) // NOLINT
+            {
+                cfg.segmentCount = static_cast<unsigned int>(std::max(std::stoi(argv[i]), 0)); // NOLINT
+            }
+            else if ((strcmp(argv[i], "--segment-duration") == 0) && (++i < argc)) // NOLINT
+            {
+                cfg.segmentDuration = static_cast<unsigned int>(std::max(std::stoi(argv[i]), 0)); // NOLINT
+            }
             else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) // NOLINT
             {
                 cfg.mustExit = true;
@@ -239,35 +543,94 @@ int main(int argc, char* argv[])
             return 0;
         }
 
-        auto transcoder = Transcoder::create(argc, argv);
-        transcoder->unserialize(config.transcoderConfig);
+        // Outputs written to the standard output would be interleaved.
+        const size_t standardOutputCount = getStandardOutputCount(config.transcoderConfig);
+        if (standardOutputCount > 1)
+        {
+            std::cerr << "Only one encoder can write to the standard output" << std::endl;
+            throw InvalidValueException();
+        }
 
-        bool quit = false;
-        auto stdinChannel = Glib::IOChannel::create_from_fd(fileno(stdin));
-        Glib::signal_io().connect(
-            [&stdinChannel, &transcoder, &quit](Glib::IOCondition /*condition*/) {
-                Glib::ustring line;
-                if (stdinChannel->read_line(line) == Glib::IO_STATUS_NORMAL)
-                {
-                    if (line.at(0) == 'c')
-                    {
-                        std::cout << "Current configuration:" << std::endl;
-                        std::cout << std::setw(2) << transcoder->serialize() << std::endl;
-                    }
-                    else if (line.at(0) == 'q')
+        if (config.outputPath.empty() && (standardOutputCount > 0))
+        {
+            FileWriter::reserveStandardOutput();
+        }
+
+        // Jobs and threads are sized from the CPUs and memory actually
+        // available to the process (CPU affinity, container quotas).
+        const auto& resources = ResourceDiscovery::getInstance();
+        resources.printSummary();
+        const unsigned int jobs = (config.jobs > 0) ? config.jobs : resources.getDefaultJobCount();
+
+        Connector::setMaxCascadeRatio(config.maxCascadeRatio);
+        FileReader::setBlockSize(static_cast<size_t>(config.readBlockInKiB) * 1024);
+        if (config.readAheadInMiB >= 0)
+        {
+            FileReader::setReadAhead(static_cast<size_t>(config.readAheadInMiB) * 1024 * 1024);
+        }
+        FileWriter::setBatchSize(static_cast<size_t>(config.writeBatchInKiB) * 1024);
+        FileWriter::setDirectIo(config.isDirectIoEnabled);
+        FileWriter::setSyncPolicy(config.syncPolicy);
+        auto pool = TranscoderPool::create(argc, argv, jobs);
+        if (config.daemonSocket.empty() || !config.transcoderConfig.empty())
+        {
+            pool->unserialize(config.transcoderConfig);
+        }
+        pool->setOutputDirectory(config.outputPath);
+        pool->setPipelineRecycling(config.isRecyclingEnabled);
+        pool->setLookahead(config.isLookaheadEnabled);
+        pool->setStageDump(config.isStageDumpEnabled);
+        pool->setThreadLimit(config.maxThreads);
+        std::cout << "Running up to " << pool->getJobCount() << " job(s) with up to " << pool->getThreadsPerJob()
+                  << " decoding/encoding thread(s) each." << std::endl;
+        pool->setSegmentation(config.segmentCount, config.segmentDuration);
+        pool->setOutputCache(config.cacheDir, static_cast<std::uint64_t>(config.cacheSizeInMiB) * 1024 * 1024);
+
+        std::unique_ptr<Daemon> daemon;
+        if (!config.daemonSocket.empty())
+        {
+            daemon = std::make_unique<Daemon>(pool, config.daemonSocket, config.outputPath);
+        }
+
+        // Commands are read from the standard input, unless a source is.
+        Glib::RefPtr<Glib::IOChannel> stdinChannel;
+        if (std::find(config.sourceUris.begin(), config.sourceUris.end(), standardInputUri) ==
+            config.sourceUris.end())
+        {
+            stdinChannel = Glib::IOChannel::create_from_fd(fileno(stdin));
+            Glib::signal_io().connect(
+                [&stdinChannel, &pool, &daemon](Glib::IOCondition /*condition*/) {
+                    Glib::ustring line;
+                    const auto status = stdinChannel->read_line(line);
+                    if ((status == Glib::IO_STATUS_NORMAL) && !line.empty())
                     {
-                        quit = true;
-                        transcoder->interruptTranscoding();
+                        if (line.at(0) == 'c')
+                        {
+                            std::cout << "Current configuration:" << std::endl;
+                            std::cout << std::setw(2) << pool->serialize() << std::endl;
+                        }
+                        else if (line.at(0) == 'q')
+                        {
+                            if (daemon)
+                            {
+                                daemon->stop();
+                            }
+                            else
+                            {
+                                pool->interruptTranscoding();
+                            }
+                        }
                     }
-                }
 
-                return true;
-            },
-            stdinChannel, Glib::IO_IN);
+                    // A daemon may be started with a closed standard input.
+                    return status != Glib::IO_STATUS_EOF;
+                },
+                stdinChannel, Glib::IO_IN);
+        }
 
         Glib::signal_timeout().connect(
-            [&transcoder]() {
-                float progress = transcoder->getProgress();
+            [&pool]() {
+                float progress = pool->getProgress();
                 if (progress > 0.F)
                 {
                     std::cout << std::fixed << std::setprecision(2) << std::setw(6) << progress * 100.F << "%  \r"
@@ -278,32 +641,13 @@ int main(int argc, char* argv[])
             },
             500);
 
-        for (const auto& uri : config.sourceUris)
+        if (daemon)
         {
-            if (quit)
-            {
-                break;
-            }
-
-            if (!config.outputPath.empty())
-            {
-                auto name = Glib::path_get_basename(uri);
-                name = name.substr(0, name.find_last_of('.'));
-                name = Glib::build_filename(config.outputPath, name);
-                name += "_transcoded_";
-
-                int index = 0;
-                std::ostringstream out(std::ios_base::app);
-                for (const auto& encoder : transcoder->getEncoders())
-                {
-                    out.str(name);
-                    out << std::setw(2) << std::setfill('0') << index++ << '.' << encoder->getType();
-                    encoder->setOutputFile(out.str());
-                }
-            }
-
-            std::cout << "Start transcoding " << uri << "..." << std::endl;
-            transcoder->transcode(uri);
+            daemon->run();
+        }
+        else
+        {
+            pool->transcode(config.sourceUris);
         }
 
         std::cout << "Exiting..." << std::endl;
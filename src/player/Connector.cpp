@@ -18,18 +18,66 @@
  */
 #include "Connector.h"
 #include "../exceptions.h"
+#include "TrackSelection.h"
+#include <algorithm>
+#include <limits>
 
-Connector::Connector(const Glib::RefPtr<Gst::Pad>& srcPad, const Gst::Pad::SlotProbe& blockingProbeSlot)
-    : m_blockingProbeId(0), m_streamType(GST_STREAM_TYPE_UNKNOWN)
+namespace
 {
-    auto name = srcPad->get_current_caps()->get_structure(0).get_name();
-    if (name == "video/x-raw")
+double maxCascadeRatio = std::numeric_limits<double>::infinity();
+
+int getIntField(const Glib::RefPtr<Gst::Caps>& caps, const char* name)
+{
+    int value = 0;
+    if ((caps->size() > 0) && caps->get_structure(0).has_field(name))
+    {
+        caps->get_structure(0).get_field(name, value);
+    }
+    return value;
+}
+
+bool isFrameRateLower(const Glib::RefPtr<Gst::Caps>& caps, const Glib::RefPtr<Gst::Caps>& sourceCaps)
+{
+    Gst::Fraction rate;
+    Gst::Fraction sourceRate;
+    if ((caps->size() == 0) || (sourceCaps->size() == 0) || !caps->get_structure(0).has_field("framerate") ||
+        !sourceCaps->get_structure(0).has_field("framerate"))
+    {
+        return false;
+    }
+
+    caps->get_structure(0).get_field("framerate", rate);
+    sourceCaps->get_structure(0).get_field("framerate", sourceRate);
+    return static_cast<gint64>(rate.num) * sourceRate.denom < static_cast<gint64>(sourceRate.num) * rate.denom;
+}
+} // namespace
+
+void Connector::setMaxCascadeRatio(double maxRatio) noexcept
+{
+    maxCascadeRatio = (maxRatio >= 0.) ? maxRatio : std::numeric_limits<double>::infinity();
+}
+
+double Connector::getMaxCascadeRatio() noexcept
+{
+    return maxCascadeRatio;
+}
+
+Connector::Connector(const Glib::RefPtr<Gst::Pad>& srcPad, int trackIndex,
+                     const Gst::Pad::SlotProbe& blockingProbeSlot)
+    : m_trackIndex(trackIndex), m_blockingProbeId(0), m_streamType(GST_STREAM_TYPE_UNKNOWN), m_isRaw(false),
+      m_isAttached(false)
+{
+    m_caps = srcPad->get_current_caps();
+    const std::string name = m_caps->get_structure(0).get_name();
+    if (name.rfind("video/", 0) == 0)
     {
         m_streamType = GST_STREAM_TYPE_VIDEO;
+        m_isRaw = (name == "video/x-raw");
     }
-    else if (name == "audio/x-raw")
+    else if (name.rfind("audio/", 0) == 0)
     {
         m_streamType = GST_STREAM_TYPE_AUDIO;
+        m_isRaw = (name == "audio/x-raw");
     }
 
     m_outputTee = Gst::Tee::create();
@@ -38,24 +86,18 @@ Connector::Connector(const Glib::RefPtr<Gst::Pad>& srcPad, const Gst::Pad::SlotP
     auto parent = Glib::RefPtr<Gst::Bin>::cast_static(srcPad->get_parent_element()->get_parent());
     parent->add(m_outputTee);
 
-    auto teeSinkPad = m_outputTee->get_static_pad("sink");
-    if (srcPad->link(teeSinkPad) != Gst::PAD_LINK_OK)
-    {
-        throw CannotLinkPadException();
-    }
+    linkSourcePad(srcPad, blockingProbeSlot);
 
     if (!m_outputTee->sync_state_with_parent())
     {
         throw InvalidStateException();
     }
-
-    m_blockingProbeId = srcPad->add_probe(Gst::PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, blockingProbeSlot);
-    m_srcPad = srcPad;
 }
 
 Connector::~Connector()
 {
     unblock();
+    disconnect();
 
     if (m_outputTee)
     {
@@ -66,21 +108,174 @@ Connector::~Connector()
         {
             parent->remove(m_outputTee);
         }
+    }
+}
+
+bool Connector::attach(const Glib::RefPtr<Gst::Pad>& srcPad, int trackIndex,
+                       const Gst::Pad::SlotProbe& blockingProbeSlot)
+{
+    // A detached connector can only be reused by a stream with exactly the
+    // same caps, so that its already negotiated output branches stay valid,
+    // and by the same track, so that they still lead to the outputs which
+    // selected it.
+    if (m_isAttached || (trackIndex != m_trackIndex) || !srcPad->get_current_caps()->is_equal(m_caps))
+    {
+        return false;
+    }
+
+    linkSourcePad(srcPad, blockingProbeSlot);
+    return true;
+}
+
+std::string Connector::getLanguage() const noexcept
+{
+    std::string language;
+    if (m_srcPad)
+    {
+        TrackSelection::getLanguage(m_srcPad->gobj(), language);
+    }
+    return language;
+}
+
+void Connector::detach() noexcept
+{
+    unblock();
+    m_isAttached = false;
+}
+
+void Connector::connect(const Glib::RefPtr<Gst::Pad>& sinkPad, const QueueSettings& queueSettings,
+                        const Glib::RefPtr<Gst::Caps>& targetCaps, const std::string& label)
+{
+    // Raw streams which must be converted (scaled, resampled...) go through
+    // a conversion stage, shared with all outputs having the same target caps,
+    // instead of being converted by each encodebin.
+    auto caps = removeIdentityFields(targetCaps);
+    if (caps && !m_caps->can_intersect(caps))
+    {
+        auto& stage = getConversionStage(caps);
+        linkBranch(stage.outputTee, sinkPad, queueSettings);
+        stage.labels.push_back(label);
+        return;
+    }
+
+    linkBranch(m_outputTee, sinkPad, queueSettings);
+    m_labels.push_back(label);
+}
+
+void Connector::linkBranch(const Glib::RefPtr<Gst::Tee>& tee, const Glib::RefPtr<Gst::Pad>& sinkPad,
+                           const QueueSettings& queueSettings)
+{
+    // Each output branch gets its own queue, and thus its own streaming
+    // thread, so that the slowest output doesn't pace all the others.
+    auto queue = Gst::Queue::create();
+    if (queueSettings.maxBuffers != QueueSettings::defaultValue)
+    {
+        queue->set_property("max-size-buffers", static_cast<guint>(queueSettings.maxBuffers));
+    }
+
+    if (queueSettings.maxBytes != QueueSettings::defaultValue)
+    {
+        queue->set_property("max-size-bytes", static_cast<guint>(queueSettings.maxBytes));
+    }
+
+    if (queueSettings.maxTimeInMs != QueueSettings::defaultValue)
+    {
+        queue->set_property("max-size-time", static_cast<guint64>(queueSettings.maxTimeInMs) * GST_MSECOND);
+    }
+
+    if (queueSettings.leaky != QueueSettings::Leaky::defaultValue)
+    {
+        queue->set_property("leaky", static_cast<int>(queueSettings.leaky));
+    }
+
+    auto parent = Glib::RefPtr<Gst::Bin>::cast_static(m_outputTee->get_parent());
+    parent->add(queue);
+    m_branchQueues.push_back(queue);
+
+    auto pad = tee->get_request_pad("src_%u");
+    if ((pad->link(queue->get_static_pad("sink")) != Gst::PAD_LINK_OK) ||
+        (queue->get_static_pad("src")->link(sinkPad) != Gst::PAD_LINK_OK))
+    {
+        throw CannotLinkPadException();
+    }
+
+    if (!queue->sync_state_with_parent())
+    {
+        throw InvalidStateException();
+    }
+}
+
+void Connector::disconnect() noexcept
+{
+    std::vector<Glib::RefPtr<Gst::Tee>> tees{m_outputTee};
+    std::vector<Glib::RefPtr<Gst::Element>> elements(m_branchQueues.begin(), m_branchQueues.end());
+    for (auto& stage : m_conversionStages)
+    {
+        tees.push_back(stage.outputTee);
+        elements.insert(elements.end(), stage.elements.begin(), stage.elements.end());
+    }
+
+    for (auto& tee : tees)
+    {
+        if (tee)
+        {
+            auto it = tee->iterate_src_pads();
+            while (it.next() == Gst::ITERATOR_OK)
+            {
+                tee->release_request_pad(*it);
+            }
+        }
+    }
+
+    for (auto& element : elements)
+    {
+        element->set_state(Gst::STATE_NULL);
+
+        auto parent = Glib::RefPtr<Gst::Bin>::cast_static(element->get_parent());
+        if (parent)
+        {
+            parent->remove(element);
+        }
+    }
+
+    m_branchQueues.clear();
+    m_conversionStages.clear();
+    m_labels.clear();
+}
 
-        auto it = m_outputTee->iterate_src_pads();
-        while (it.next() == Gst::ITERATOR_OK)
+bool Connector::isConnected() const noexcept
+{
+    for (const auto& queue : m_branchQueues)
+    {
+        if (!queue->get_static_pad("src")->is_linked())
         {
-            m_outputTee->release_request_pad(*it);
+            return false;
         }
     }
+
+    return true;
 }
 
-void Connector::connect(const Glib::RefPtr<Gst::Pad>& sinkPad)
+void Connector::dump(std::ostream& out) const
 {
-    auto pad = m_outputTee->get_request_pad("src_%u");
-    if (pad->link(sinkPad) != Gst::PAD_LINK_OK)
+    out << "  " << m_caps->to_string() << std::endl;
+    for (const auto& label : m_labels)
     {
-        throw CannotLinkPadException();
+        out << "    -> " << label << std::endl;
+    }
+
+    for (const auto& stage : m_conversionStages)
+    {
+        out << "    converted to " << stage.caps->to_string() << " for " << stage.labels.size() << " output(s)";
+        if (stage.inputPad && (stage.inputPad->get_parent_element().get() != m_outputTee.get()))
+        {
+            out << ", scaled from " << stage.inputWidth << "x" << stage.inputHeight;
+        }
+        out << std::endl;
+        for (const auto& label : stage.labels)
+        {
+            out << "      -> " << label << std::endl;
+        }
     }
 }
 
@@ -93,3 +288,278 @@ void Connector::unblock() noexcept
         m_blockingProbeId = 0;
     }
 }
+
+bool Connector::sendUpstreamEvent(const Glib::RefPtr<Gst::Event>& event) noexcept
+{
+    return m_srcPad && m_srcPad->send_event(event);
+}
+
+Connector::ConversionStage& Connector::getConversionStage(const Glib::RefPtr<Gst::Caps>& caps)
+{
+    for (auto& stage : m_conversionStages)
+    {
+        if (stage.caps->is_equal(caps))
+        {
+            return stage;
+        }
+    }
+
+    // The stage runs in its own streaming thread, behind a queue. It only
+    // has the converters its caps require, cheapest first: frames and
+    // channels are dropped before the remaining ones are scaled, resampled
+    // or converted, and added after.
+    std::vector<const char*> converters;
+    if ((m_streamType & GST_STREAM_TYPE_AUDIO) != 0)
+    {
+        converters.push_back("audioconvert");
+        if (caps->get_structure(0).has_field("rate"))
+        {
+            const bool isUpmixed = (getIntField(caps, "channels") > getIntField(m_caps, "channels"));
+            converters.insert(isUpmixed ? converters.begin() : converters.end(), "audioresample");
+        }
+    }
+    else
+    {
+        int width = 0;
+        int height = 0;
+        int sourceWidth = 0;
+        int sourceHeight = 0;
+        getFrameSize(caps, width, height);
+        getFrameSize(m_caps, sourceWidth, sourceHeight);
+        const auto data = caps->get_structure(0);
+        const bool isScaled = data.has_field("width") || data.has_field("height");
+        const bool isDownscaled = isScaled && (static_cast<gint64>(width) * height <
+                                               static_cast<gint64>(sourceWidth) * sourceHeight);
+        const bool isRateChanged = data.has_field("framerate");
+        const bool isDecimated = isRateChanged && isFrameRateLower(caps, m_caps);
+
+        if (isDecimated)
+        {
+            converters.push_back("videorate");
+        }
+        if (isDownscaled)
+        {
+            converters.push_back("videoscale");
+        }
+        converters.push_back("videoconvert");
+        if (isScaled && !isDownscaled)
+        {
+            converters.push_back("videoscale");
+        }
+        if (isRateChanged && !isDecimated)
+        {
+            converters.push_back("videorate");
+        }
+    }
+
+    ConversionStage stage;
+    stage.caps = caps;
+    stage.elements.push_back(Gst::Queue::create());
+    for (const char* factory : converters)
+    {
+        stage.elements.push_back(Gst::ElementFactory::create_element(factory));
+    }
+
+    auto capsFilter = Gst::CapsFilter::create();
+    capsFilter->property_caps() = caps;
+    stage.elements.push_back(capsFilter);
+
+    stage.outputTee = Gst::Tee::create();
+    stage.outputTee->property_allow_not_linked() = true;
+    stage.elements.push_back(stage.outputTee);
+
+    if (std::find(stage.elements.begin(), stage.elements.end(), Glib::RefPtr<Gst::Element>()) != stage.elements.end())
+    {
+        throw UnrecoverableError();
+    }
+
+    // Stored first, so that elements are removed by disconnect() on failure.
+    m_conversionStages.push_back(std::move(stage));
+    auto& entry = m_conversionStages.back();
+
+    auto parent = Glib::RefPtr<Gst::Bin>::cast_static(m_outputTee->get_parent());
+    for (size_t i = 0; i < entry.elements.size(); ++i)
+    {
+        parent->add(entry.elements[i]);
+        if ((i > 0) && !entry.elements[i - 1]->link(entry.elements[i]))
+        {
+            throw CannotLinkPadException();
+        }
+    }
+
+    // Renditions of a video ladder are scaled from the nearest larger one
+    // rather than all from the source. Connector outputs are only linked
+    // while the source pad is blocked, so stages can still be relinked.
+    getFrameSize(caps, entry.width, entry.height);
+    const ConversionStage* from = nullptr;
+    for (const auto& stage : m_conversionStages)
+    {
+        if ((&stage != &entry) && canCascade(stage, entry) &&
+            (!from || (stage.width * stage.height < from->width * from->height)))
+        {
+            from = &stage;
+        }
+    }
+    linkConversionStage(entry, from);
+
+    for (auto& stage : m_conversionStages)
+    {
+        if ((&stage != &entry) && canCascade(entry, stage) &&
+            (entry.width * entry.height < stage.inputWidth * stage.inputHeight))
+        {
+            linkConversionStage(stage, &entry);
+        }
+    }
+
+    for (auto& element : entry.elements)
+    {
+        if (!element->sync_state_with_parent())
+        {
+            throw InvalidStateException();
+        }
+    }
+
+    return entry;
+}
+
+Glib::RefPtr<Gst::Caps> Connector::removeIdentityFields(const Glib::RefPtr<Gst::Caps>& targetCaps) const
+{
+    // Target values which are already the source ones would only add no-op
+    // converters and split outputs between identical conversion stages.
+    if (!m_isRaw || !targetCaps || (targetCaps->size() == 0) || (m_caps->size() == 0))
+    {
+        return Glib::RefPtr<Gst::Caps>();
+    }
+
+    auto caps = targetCaps->copy();
+    GstStructure* target = gst_caps_get_structure(caps->gobj(), 0);
+    const GstStructure* source = gst_caps_get_structure(m_caps->gobj(), 0);
+    for (gint i = gst_structure_n_fields(target) - 1; i >= 0; --i)
+    {
+        const gchar* name = gst_structure_nth_field_name(target, static_cast<guint>(i));
+        const GValue* sourceValue = gst_structure_get_value(source, name);
+        if ((sourceValue != nullptr) &&
+            (gst_value_compare(gst_structure_get_value(target, name), sourceValue) == GST_VALUE_EQUAL))
+        {
+            gst_structure_remove_field(target, name);
+        }
+    }
+
+    return (gst_structure_n_fields(target) > 0) ? caps : Glib::RefPtr<Gst::Caps>();
+}
+
+void Connector::getFrameSize(const Glib::RefPtr<Gst::Caps>& caps, int& width, int& height) const noexcept
+{
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+    auto source = m_caps->get_structure(0);
+    source.get_field("width", sourceWidth);
+    source.get_field("height", sourceHeight);
+
+    width = 0;
+    height = 0;
+    auto target = caps->get_structure(0);
+    if (target.has_field("width"))
+    {
+        target.get_field("width", width);
+    }
+    if (target.has_field("height"))
+    {
+        target.get_field("height", height);
+    }
+
+    // A single dimension keeps the source aspect ratio.
+    if ((sourceWidth <= 0) || (sourceHeight <= 0))
+    {
+        return;
+    }
+
+    if ((width <= 0) && (height <= 0))
+    {
+        width = sourceWidth;
+        height = sourceHeight;
+    }
+    else if (height <= 0)
+    {
+        height = static_cast<int>(static_cast<gint64>(sourceHeight) * width / sourceWidth);
+    }
+    else if (width <= 0)
+    {
+        width = static_cast<int>(static_cast<gint64>(sourceWidth) * height / sourceHeight);
+    }
+}
+
+bool Connector::canCascade(const ConversionStage& from, const ConversionStage& to) const noexcept
+{
+    if (((m_streamType & GST_STREAM_TYPE_VIDEO) == 0) || (from.width <= 0) || (from.height <= 0) ||
+        (to.width <= 0) || (to.height <= 0) || (from.width < to.width) || (from.height < to.height) ||
+        ((from.width == to.width) && (from.height == to.height)))
+    {
+        return false;
+    }
+
+    // Upscaled frames have no more details than the source ones.
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+    getFrameSize(m_caps, sourceWidth, sourceHeight);
+    if ((from.width > sourceWidth) || (from.height > sourceHeight))
+    {
+        return false;
+    }
+
+    // Frames already converted to another frame rate can't be used.
+    auto fromData = from.caps->get_structure(0);
+    auto toData = to.caps->get_structure(0);
+    if (fromData.has_field("framerate"))
+    {
+        Gst::Fraction fromRate;
+        Gst::Fraction toRate;
+        fromData.get_field("framerate", fromRate);
+        if (!toData.has_field("framerate") || !toData.get_field("framerate", toRate) ||
+            (static_cast<gint64>(fromRate.num) * toRate.denom != static_cast<gint64>(toRate.num) * fromRate.denom))
+        {
+            return false;
+        }
+    }
+
+    const double ratio =
+        std::max(static_cast<double>(from.width) / to.width, static_cast<double>(from.height) / to.height);
+    return ratio <= maxCascadeRatio;
+}
+
+void Connector::linkConversionStage(ConversionStage& stage, const ConversionStage* from)
+{
+    auto sinkPad = stage.elements.front()->get_static_pad("sink");
+    if (stage.inputPad)
+    {
+        auto tee = Glib::RefPtr<Gst::Tee>::cast_static(stage.inputPad->get_parent_element());
+        stage.inputPad->unlink(sinkPad);
+        tee->release_request_pad(stage.inputPad);
+    }
+
+    const auto& tee = from ? from->outputTee : m_outputTee;
+    stage.inputPad = tee->get_request_pad("src_%u");
+    if (stage.inputPad->link(sinkPad) != Gst::PAD_LINK_OK)
+    {
+        throw CannotLinkPadException();
+    }
+
+    getFrameSize(from ? from->caps : m_caps, stage.inputWidth, stage.inputHeight);
+}
+
+void Connector::linkSourcePad(const Glib::RefPtr<Gst::Pad>& srcPad, const Gst::Pad::SlotProbe& blockingProbeSlot)
+{
+    auto teeSinkPad = m_outputTee->get_static_pad("sink");
+    if (srcPad->link(teeSinkPad) != Gst::PAD_LINK_OK)
+    {
+        throw CannotLinkPadException();
+    }
+
+    m_blockingProbeId = srcPad->add_probe(Gst::PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, blockingProbeSlot);
+    m_srcPad = srcPad;
+
+    gchar* streamId = gst_pad_get_stream_id(srcPad->gobj());
+    m_streamId = (streamId != nullptr) ? streamId : "";
+    g_free(streamId);
+    m_isAttached = true;
+}
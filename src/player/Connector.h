@@ -19,11 +19,37 @@
 #pragma once
 
 #include <gstreamermm.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct QueueSettings
+{
+    static constexpr int defaultValue = -1;
+
+    enum class Leaky : int
+    {
+        defaultValue = defaultValue,
+        no,
+        upstream,
+        downstream
+    };
+
+    int maxBuffers = defaultValue;
+    int maxBytes = defaultValue;
+    int maxTimeInMs = defaultValue;
+    Leaky leaky = Leaky::defaultValue;
+};
 
 class Connector final
 {
   public:
-    Connector(const Glib::RefPtr<Gst::Pad>& srcPad, const Gst::Pad::SlotProbe& blockingProbeSlot);
+    // Video conversion stages are derived from the nearest larger one, if it
+    // is at most maxRatio times larger (0 disables cascading).
+    static void setMaxCascadeRatio(double maxRatio) noexcept;
+    static double getMaxCascadeRatio() noexcept;
+
+    Connector(const Glib::RefPtr<Gst::Pad>& srcPad, int trackIndex, const Gst::Pad::SlotProbe& blockingProbeSlot);
     ~Connector();
 
     Connector(const Connector&) = delete;
@@ -36,12 +62,79 @@ class Connector final
         return m_streamType;
     }
 
-    void connect(const Glib::RefPtr<Gst::Pad>& sinkPad);
+    // Compressed streams are only exposed for passthrough.
+    bool isRaw() const noexcept
+    {
+        return m_isRaw;
+    }
+
+    const Glib::RefPtr<Gst::Caps>& getCaps() const noexcept
+    {
+        return m_caps;
+    }
+
+    // Index of the source track among the tracks of the same type.
+    int getTrackIndex() const noexcept
+    {
+        return m_trackIndex;
+    }
+    const std::string& getStreamId() const noexcept
+    {
+        return m_streamId;
+    }
+    std::string getLanguage() const noexcept;
+
+    bool isAttached() const noexcept
+    {
+        return m_isAttached;
+    }
+
+    bool attach(const Glib::RefPtr<Gst::Pad>& srcPad, int trackIndex, const Gst::Pad::SlotProbe& blockingProbeSlot);
+    void detach() noexcept;
+
+    // Outputs with the same target raw caps share the same conversion stage.
+    void connect(const Glib::RefPtr<Gst::Pad>& sinkPad, const QueueSettings& queueSettings = QueueSettings(),
+                 const Glib::RefPtr<Gst::Caps>& targetCaps = Glib::RefPtr<Gst::Caps>(),
+                 const std::string& label = std::string());
+    void disconnect() noexcept;
+    bool isConnected() const noexcept;
+    void dump(std::ostream& out) const;
     void unblock() noexcept;
+    bool sendUpstreamEvent(const Glib::RefPtr<Gst::Event>& event) noexcept;
 
   private:
+    struct ConversionStage
+    {
+        Glib::RefPtr<Gst::Caps> caps;
+        Glib::RefPtr<Gst::Tee> outputTee;
+        std::vector<Glib::RefPtr<Gst::Element>> elements;
+        std::vector<std::string> labels;
+        int width = 0;
+        int height = 0;
+        int inputWidth = 0;
+        int inputHeight = 0;
+        Glib::RefPtr<Gst::Pad> inputPad;
+    };
+
     Glib::RefPtr<Gst::Tee> m_outputTee;
+    std::vector<Glib::RefPtr<Gst::Queue>> m_branchQueues;
+    std::vector<ConversionStage> m_conversionStages;
+    std::vector<std::string> m_labels;
     Glib::RefPtr<Gst::Pad> m_srcPad;
+    Glib::RefPtr<Gst::Caps> m_caps;
+    std::string m_streamId;
+    int m_trackIndex;
     unsigned long m_blockingProbeId;
     GstStreamType m_streamType;
+    bool m_isRaw;
+    bool m_isAttached;
+
+    void linkSourcePad(const Glib::RefPtr<Gst::Pad>& srcPad, const Gst::Pad::SlotProbe& blockingProbeSlot);
+    void linkBranch(const Glib::RefPtr<Gst::Tee>& tee, const Glib::RefPtr<Gst::Pad>& sinkPad,
+                    const QueueSettings& queueSettings);
+    ConversionStage& getConversionStage(const Glib::RefPtr<Gst::Caps>& caps);
+    Glib::RefPtr<Gst::Caps> removeIdentityFields(const Glib::RefPtr<Gst::Caps>& targetCaps) const;
+    void getFrameSize(const Glib::RefPtr<Gst::Caps>& caps, int& width, int& height) const noexcept;
+    bool canCascade(const ConversionStage& from, const ConversionStage& to) const noexcept;
+    void linkConversionStage(ConversionStage& stage, const ConversionStage* from);
 };
@@ -18,13 +18,79 @@
  */
 #include "../exceptions.h"
 #include "IPlayerListener.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+
+namespace
+{
+std::atomic_int streamingThreads(0);
+std::atomic_int peakStreamingThreads(0);
+
+// Values of the uridecodebin GstAutoplugSelectResult enum (not exported).
+constexpr int autoplugSelectTry = 0;
+constexpr int autoplugSelectExpose = 1;
+
+GstStreamType getStreamType(const GstCaps* caps) noexcept
+{
+    if ((caps == nullptr) || (gst_caps_get_size(caps) == 0))
+    {
+        return GST_STREAM_TYPE_UNKNOWN;
+    }
+
+    const gchar* name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+    if (g_str_has_prefix(name, "video/") != FALSE)
+    {
+        return GST_STREAM_TYPE_VIDEO;
+    }
+    if (g_str_has_prefix(name, "audio/") != FALSE)
+    {
+        return GST_STREAM_TYPE_AUDIO;
+    }
+    return GST_STREAM_TYPE_UNKNOWN;
+}
+
+void setIntProperty(GstElement* element, const char* name, int value) noexcept
+{
+    GParamSpec* spec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), name); // NOLINT
+    if (spec != nullptr)
+    {
+        GValue gValue = G_VALUE_INIT;
+        g_value_init(&gValue, G_TYPE_INT);
+        g_value_set_int(&gValue, value);
+        g_object_set_property(G_OBJECT(element), name, &gValue); // NOLINT
+        g_value_unset(&gValue);
+    }
+}
+
+void updatePeak(std::atomic_int& peak, int value) noexcept
+{
+    int current = peak;
+    while ((value > current) && !peak.compare_exchange_weak(current, value))
+    {
+        // Retry with the updated current value.
+    }
+}
+} // namespace
 
 const GQuark Player::errorDomain = Glib::Quark("PlayerErrorDomain");
 
+int Player::getStreamingThreadCount() noexcept
+{
+    return streamingThreads;
+}
+
+int Player::getPeakStreamingThreadCount() noexcept
+{
+    return peakStreamingThreads;
+}
+
 Player::Player()
-    : m_busWatchId(0), m_prerollingPads(1), m_prerollDone(false), m_currentState(State::stopped),
-      m_pendingState(State::undefined), m_interrupted(false)
+    : m_busWatchId(0), m_isHeld(false), m_prerollingPads(1), m_prerollDone(false), m_streamingThreads(0),
+      m_peakStreamingThreads(0), m_decoderThreadLimit(0), m_streamTypes(GST_STREAM_TYPE_UNKNOWN),
+      m_isRecyclingEnabled(false), m_isRecycled(false), m_recycledConnectors(0), m_recycleCount(0),
+      m_startTime(undefinedTime), m_endTime(undefinedTime), m_seekMode(SeekMode::accurate),
+      m_currentState(State::stopped), m_pendingState(State::undefined), m_interrupted(false)
 {
     m_pipeline = Gst::Pipeline::create();
     m_uriDecodeBin = Gst::UriDecodeBin::create();
@@ -32,9 +98,16 @@ Player::Player()
     try
     {
         m_busWatchId = m_pipeline->get_bus()->add_watch(sigc::mem_fun(*this, &Player::onBusMessage));
+        m_pipeline->get_bus()->set_sync_handler(sigc::mem_fun(*this, &Player::onSyncBusMessage));
         m_pipeline->add(m_uriDecodeBin);
 
         m_uriDecodeBin->signal_pad_added().connect(sigc::mem_fun(*this, &Player::onPadAdded));
+        g_signal_connect(m_uriDecodeBin->gobj(), "autoplug-continue", G_CALLBACK(&Player::onAutoplugContinue),
+                         this); // NOLINT
+        g_signal_connect(m_uriDecodeBin->gobj(), "autoplug-select", G_CALLBACK(&Player::onAutoplugSelect),
+                         this); // NOLINT
+        g_signal_connect(m_uriDecodeBin->gobj(), "deep-element-added", G_CALLBACK(&Player::onDeepElementAdded),
+                         this); // NOLINT
         m_uriDecodeBin->signal_no_more_pads().connect([this]() {
             // WARNING: called from any streaming thread.
             this->onPadPrerolled();
@@ -54,9 +127,57 @@ Player::~Player()
         m_pendingState = State::stopped;
     }
     stop();
+    m_pipeline->set_state(Gst::STATE_NULL);
+    gst_bus_set_sync_handler(m_pipeline->get_bus()->gobj(), nullptr, nullptr, nullptr);
     m_pipeline->get_bus()->remove_watch(m_busWatchId);
 }
 
+void Player::setDecoderThreadLimit(int n) noexcept
+{
+    m_decoderThreadLimit = std::max(n, 0);
+}
+
+void Player::setPassthroughCaps(const Glib::RefPtr<Gst::Caps>& caps)
+{
+    if (!hasStableState(State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    m_passthroughCaps = caps;
+}
+
+void Player::setStreamTypes(GstStreamType streamTypes)
+{
+    if (!hasStableState(State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    m_streamTypes = streamTypes;
+}
+
+void Player::setTrackSelections(const std::vector<TrackSelection>& videoTracks,
+                                const std::vector<TrackSelection>& audioTracks)
+{
+    if (!hasStableState(State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    // A track is decoded if any of the selections selects it.
+    m_videoTracks = videoTracks;
+    m_audioTracks = audioTracks;
+    for (auto* tracks : {&m_videoTracks, &m_audioTracks})
+    {
+        if (std::any_of(tracks->begin(), tracks->end(),
+                        [](const TrackSelection& selection) { return selection.empty(); }))
+        {
+            tracks->clear();
+        }
+    }
+}
+
 void Player::addPlayerListener(const std::shared_ptr<IPlayerListener>& listener) noexcept
 {
     if (listener)
@@ -119,11 +240,58 @@ void Player::forEachConnector(const std::function<void(Connector&)>& cb)
     }
 }
 
+void Player::dumpConnectors(std::ostream& out) const
+{
+    for (const auto& connector : m_connectors)
+    {
+        connector.dump(out);
+    }
+}
+
 bool Player::hasStableState(State state) const noexcept
 {
     return (m_currentState == state) && (m_pendingState == State::undefined);
 }
 
+void Player::setPlaybackRange(gint64 startTime, gint64 endTime, SeekMode seekMode)
+{
+    if (!hasStableState(State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    m_startTime = (startTime > 0) ? startTime : undefinedTime;
+    m_endTime = (endTime > 0) ? endTime : undefinedTime;
+    m_seekMode = seekMode;
+}
+
+void Player::setRecycling(bool isEnabled)
+{
+    if (!hasStableState(State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    m_isRecyclingEnabled = isEnabled;
+    if (!isEnabled)
+    {
+        releaseConnectors();
+    }
+}
+
+void Player::releaseConnectors()
+{
+    if (!hasStableState(State::stopped))
+    {
+        throw InvalidStateException();
+    }
+
+    m_pipeline->set_state(Gst::STATE_NULL);
+    m_connectors.clear();
+    m_recycledConnectors = 0;
+    m_isRecycled = false;
+}
+
 void Player::play(const Glib::ustring& uri)
 {
     if (!hasStableState(State::stopped))
@@ -131,16 +299,46 @@ void Player::play(const Glib::ustring& uri)
         throw InvalidStateException();
     }
 
-    assert(m_connectors.empty()); // NOLINT
+    assert(m_connectors.size() == m_recycledConnectors); // NOLINT
+
+    {
+        const std::lock_guard<std::mutex> lock(m_tracksLock);
+        m_tracks.clear();
+    }
 
+    m_isRecycled = false;
+    m_isHeld = false;
     m_prerollingPads = 1;
     m_prerollDone = false;
     m_pendingState = State::prerolled;
     m_interrupted = false;
+    m_uri = uri;
     m_uriDecodeBin->property_uri() = uri;
     m_pipeline->set_state(Gst::STATE_PAUSED);
 }
 
+void Player::preroll(const Glib::ustring& uri)
+{
+    // Same as play, but the player is held in the prerolled state, with all
+    // connectors blocked, and listeners are not notified until resumed.
+    play(uri);
+    m_isHeld = true;
+}
+
+void Player::resume()
+{
+    if (!m_isHeld)
+    {
+        throw InvalidStateException();
+    }
+
+    m_isHeld = false;
+    if (hasStableState(State::prerolled))
+    {
+        startPlaying();
+    }
+}
+
 void Player::stop() noexcept
 {
     if (hasStableState(State::playing))
@@ -150,7 +348,19 @@ void Player::stop() noexcept
     }
     else if (!hasStableState(State::stopped))
     {
-        m_pipeline->set_state(Gst::STATE_NULL);
+        // A held player stopped before being resumed has been cancelled.
+        if (m_isHeld)
+        {
+            m_isHeld = false;
+            m_interrupted = true;
+        }
+
+        // After a clean end of stream, the pipeline is only reset to READY
+        // so that connectors and encoders elements can be reused by the next
+        // source. The uridecodebin removes its pads on the way, leaving all
+        // connectors detached.
+        const bool mustRecycle = m_isRecyclingEnabled && !m_interrupted;
+        m_pipeline->set_state(mustRecycle ? Gst::STATE_READY : Gst::STATE_NULL);
 
         m_currentState = State::stopped;
         m_pendingState = State::undefined;
@@ -162,11 +372,23 @@ void Player::stop() noexcept
         // may still have concurrent accesses from onPadAdded probes.
         const std::lock_guard<std::mutex> lock(m_connectorsWriteLock);
         m_prerollDone = true;
-        m_connectors.clear();
+        if (mustRecycle)
+        {
+            for (auto& connector : m_connectors)
+            {
+                connector.detach();
+            }
+            m_recycledConnectors = m_connectors.size();
+        }
+        else
+        {
+            m_connectors.clear();
+            m_recycledConnectors = 0;
+        }
     }
 }
 
-bool Player::onBusMessage(const Glib::RefPtr<Gst::Bus>& bus, const Glib::RefPtr<Gst::Message>& message) noexcept
+bool Player::onBusMessage(const Glib::RefPtr<Gst::Bus>& /*bus*/, const Glib::RefPtr<Gst::Message>& message) noexcept
 {
     switch (message->get_message_type())
     {
@@ -191,23 +413,18 @@ bool Player::onBusMessage(const Glib::RefPtr<Gst::Bus>& bus, const Glib::RefPtr<
             m_pendingState = State::undefined;
             try
             {
-                triggerPlayerPrerolled();
-
-                for (auto& connector : m_connectors)
-                {
-                    connector.unblock();
-                }
-
-                m_pendingState = State::playing;
-                m_pipeline->set_state(Gst::STATE_PLAYING);
+                checkRecycledConnectors();
+                seekToPlaybackRange();
             }
             catch (const std::exception& e)
             {
-                bus->post(Gst::MessageError::create(m_pipeline,
-                                                    Glib::Error(errorDomain,
-                                                                static_cast<int>(ErrorCode::cannotInitializePipeline),
-                                                                "cannot initialize pipeline"),
-                                                    e.what()));
+                postInitializationError(e);
+                break;
+            }
+
+            if (!m_isHeld)
+            {
+                startPlaying();
             }
         }
         break;
@@ -231,6 +448,11 @@ bool Player::onBusMessage(const Glib::RefPtr<Gst::Bus>& bus, const Glib::RefPtr<
         {
             error = Glib::Error(errorDomain, static_cast<int>(ErrorCode::undefined), "undefined error");
         }
+
+        // A pipeline in error will never drain to EOS, so force it down to
+        // the stopped state and report it as interrupted.
+        m_interrupted = true;
+        m_pendingState = State::stopped;
         stop();
         triggerPipelineIssue(true, error, debugMessage);
         break;
@@ -260,6 +482,102 @@ bool Player::onBusMessage(const Glib::RefPtr<Gst::Bus>& bus, const Glib::RefPtr<
     return true;
 }
 
+Gst::BusSyncReply Player::onSyncBusMessage(const Glib::RefPtr<Gst::Bus>& /*bus*/,
+                                           const Glib::RefPtr<Gst::Message>& message) noexcept
+{
+    // WARNING: called from any streaming thread.
+    if (message->get_message_type() != Gst::MESSAGE_STREAM_STATUS)
+    {
+        return Gst::BUS_PASS;
+    }
+
+    GstStreamStatusType type = GST_STREAM_STATUS_TYPE_CREATE;
+    GstElement* owner = nullptr;
+    gst_message_parse_stream_status(message->gobj(), &type, &owner);
+    switch (type)
+    {
+    case GST_STREAM_STATUS_TYPE_ENTER:
+        updatePeak(m_peakStreamingThreads, ++m_streamingThreads);
+        updatePeak(peakStreamingThreads, ++streamingThreads);
+        break;
+
+    case GST_STREAM_STATUS_TYPE_LEAVE:
+        --m_streamingThreads;
+        --streamingThreads;
+        break;
+
+    default:
+        break;
+    }
+
+    // Streaming threads status is entirely handled here.
+    return Gst::BUS_DROP;
+}
+
+gboolean Player::onAutoplugContinue(GstElement* /*bin*/, GstPad* pad, GstCaps* caps, Player* player) noexcept
+{
+    // WARNING: called from any streaming thread.
+    // Streams matching the passthrough caps are exposed without being decoded.
+    const auto& passthroughCaps = player->m_passthroughCaps;
+    if (!passthroughCaps || !gst_caps_can_intersect(caps, passthroughCaps->gobj()))
+    {
+        return TRUE;
+    }
+
+    player->selectTrack(getStreamType(caps), pad, false);
+    return FALSE;
+}
+
+int Player::onAutoplugSelect(GstElement* /*bin*/, GstPad* pad, GstCaps* caps, GstElementFactory* factory,
+                             Player* player) noexcept
+{
+    // WARNING: called from any streaming thread.
+    // Streams of a type nobody uses, or tracks nobody selected, are exposed
+    // before their decoder, to be dropped as they come out of the demuxer
+    // (see onPadAdded).
+    const GstStreamType streamType = getStreamType(caps);
+    const gchar* klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+    if ((streamType == GST_STREAM_TYPE_UNKNOWN) || (klass == nullptr))
+    {
+        return autoplugSelectTry;
+    }
+
+    const bool isDecoder = (strstr(klass, "Decoder") != nullptr);
+    if (isDecoder && (player->m_streamTypes != GST_STREAM_TYPE_UNKNOWN) && ((streamType & player->m_streamTypes) == 0))
+    {
+        return autoplugSelectExpose;
+    }
+
+    // Container formats also have audio/video caps, tracks only come out of
+    // demuxers.
+    if (!isDecoder && (strstr(klass, "Parser") == nullptr))
+    {
+        return autoplugSelectTry;
+    }
+
+    return player->selectTrack(streamType, pad, isDecoder) ? autoplugSelectTry : autoplugSelectExpose;
+}
+
+void Player::onDeepElementAdded(GstBin* /*bin*/, GstBin* /*subBin*/, GstElement* element, Player* player) noexcept
+{
+    // WARNING: called from any streaming thread.
+    const int limit = player->m_decoderThreadLimit;
+    GstElementFactory* factory = gst_element_get_factory(element);
+    if ((limit == 0) || (factory == nullptr))
+    {
+        return;
+    }
+
+    // Decoders size their threads pools from the host CPU count by default
+    // (libav decoders use max-threads, vpx decoders use threads).
+    const gchar* klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+    if ((klass != nullptr) && (strstr(klass, "Decoder") != nullptr))
+    {
+        setIntProperty(element, "max-threads", limit);
+        setIntProperty(element, "threads", limit);
+    }
+}
+
 void Player::onPadAdded(const Glib::RefPtr<Gst::Pad>& pad) noexcept
 {
     // WARNING: called from any streaming thread.
@@ -268,21 +586,60 @@ void Player::onPadAdded(const Glib::RefPtr<Gst::Pad>& pad) noexcept
         return;
     }
 
-    ++this->m_prerollingPads;
-
     try
     {
-        Connector connector(pad, [this](const Glib::RefPtr<Gst::Pad>& /*pad*/, const Gst::PadProbeInfo& /*info*/) {
+        auto caps = pad->get_current_caps();
+        const GstStreamType streamType = getStreamType(caps ? caps->gobj() : nullptr);
+        int trackIndex = -1;
+        bool isSkipped = (m_streamTypes != GST_STREAM_TYPE_UNKNOWN) && (streamType != GST_STREAM_TYPE_UNKNOWN) &&
+                         ((streamType & m_streamTypes) == 0);
+
+        gchar* streamId = gst_pad_get_stream_id(pad->gobj());
+        if ((streamId != nullptr) && (streamType != GST_STREAM_TYPE_UNKNOWN))
+        {
+            const std::lock_guard<std::mutex> lock(m_tracksLock);
+            const auto& track = getTrack(streamType, streamId);
+            trackIndex = track.index;
+            isSkipped = isSkipped || track.isSkipped;
+        }
+        g_free(streamId);
+
+        if (isSkipped)
+        {
+            pad->add_probe(Gst::PAD_PROBE_TYPE_BUFFER | Gst::PAD_PROBE_TYPE_BUFFER_LIST,
+                           [](const Glib::RefPtr<Gst::Pad>& /*pad*/, const Gst::PadProbeInfo& /*info*/) {
+                               // WARNING: called from any streaming thread.
+                               return Gst::PAD_PROBE_DROP;
+                           });
+            return;
+        }
+
+        ++this->m_prerollingPads;
+
+        auto blockingProbe = [this](const Glib::RefPtr<Gst::Pad>& /*pad*/, const Gst::PadProbeInfo& /*info*/) {
             // WARNING: called from any streaming thread.
             this->onPadPrerolled();
             return Gst::PAD_PROBE_OK;
-        });
+        };
 
         // This method may be called from any streaming thread depending on the pad added,
         // so we need to protect m_connectors against race conditions. After "preroll_done"
         // message has been received on main thread (with a memory barrier), m_connectors
         // vector is exclusively used from the main thread and thus doesn't need special
         // synchronization anymore.
+        {
+            const std::lock_guard<std::mutex> lock(m_connectorsWriteLock);
+            for (size_t i = 0; (i < m_recycledConnectors) && !m_prerollDone; ++i)
+            {
+                if (m_connectors[i].attach(pad, trackIndex, blockingProbe))
+                {
+                    return;
+                }
+            }
+        }
+
+        Connector connector(pad, trackIndex, blockingProbe);
+
         const std::lock_guard<std::mutex> lock(m_connectorsWriteLock);
         if (!m_prerollDone)
         {
@@ -299,6 +656,72 @@ void Player::onPadAdded(const Glib::RefPtr<Gst::Pad>& pad) noexcept
     }
 }
 
+Player::Track& Player::getTrack(GstStreamType streamType, const std::string& streamId)
+{
+    // Tracks are numbered per type in the order the demuxer exposes them.
+    auto it = m_tracks.find(streamId);
+    if (it == m_tracks.end())
+    {
+        const auto index = std::count_if(m_tracks.begin(), m_tracks.end(), [streamType](const auto& entry) {
+            return entry.second.streamType == streamType;
+        });
+        it = m_tracks.emplace(streamId, Track{streamType, static_cast<int>(index), false}).first;
+    }
+    return it->second;
+}
+
+bool Player::selectTrack(GstStreamType streamType, GstPad* pad, bool isDecoder) noexcept
+{
+    // WARNING: called from any streaming thread.
+    gchar* id = gst_pad_get_stream_id(pad);
+    if (id == nullptr)
+    {
+        return true;
+    }
+    const std::string streamId = id;
+    g_free(id);
+
+    try
+    {
+        const std::lock_guard<std::mutex> lock(m_tracksLock);
+        auto& track = getTrack(streamType, streamId);
+        if (!isDecoder)
+        {
+            return !track.isSkipped;
+        }
+
+        // Stream tags may still be waiting in front of the parser.
+        std::string language;
+        bool hasLanguage = TrackSelection::getLanguage(pad, language);
+        GstElement* parent = gst_pad_get_parent_element(pad);
+        if (parent != nullptr)
+        {
+            GstPad* sinkPad = gst_element_get_static_pad(parent, "sink");
+            if (!hasLanguage && (sinkPad != nullptr))
+            {
+                hasLanguage = TrackSelection::getLanguage(sinkPad, language);
+            }
+            if (sinkPad != nullptr)
+            {
+                gst_object_unref(sinkPad);
+            }
+            gst_object_unref(parent);
+        }
+
+        const auto& selections = ((streamType & GST_STREAM_TYPE_VIDEO) != 0) ? m_videoTracks : m_audioTracks;
+        track.isSkipped = !selections.empty() &&
+                          std::none_of(selections.begin(), selections.end(), [&](const TrackSelection& selection) {
+                              return selection.isSelected(track.index, streamId,
+                                                          hasLanguage ? language.c_str() : nullptr);
+                          });
+        return !track.isSkipped;
+    }
+    catch (const std::exception& e)
+    {
+        return true;
+    }
+}
+
 void Player::onPadPrerolled() noexcept
 {
     // WARNING: called from any streaming thread.
@@ -313,6 +736,107 @@ void Player::onPadPrerolled() noexcept
     }
 }
 
+void Player::seekToPlaybackRange()
+{
+    if ((m_startTime == undefinedTime) && (m_endTime == undefinedTime))
+    {
+        return;
+    }
+
+    // Connectors are still blocked and no sink has been added yet, so the
+    // seek event is sent upstream from a connector source pad: the flush
+    // wakes up the blocked streaming threads which then block again on the
+    // first buffer of the requested range. Only the demuxer needs to receive
+    // the event, so the first connector accepting it is enough. Media before
+    // the start time is never decoded (beyond the previous key frame for
+    // accurate seeks), and the pipeline drains to EOS at the end time.
+    const auto flags = (m_seekMode == SeekMode::keyframe)
+                           ? Gst::SEEK_FLAG_FLUSH | Gst::SEEK_FLAG_KEY_UNIT | Gst::SEEK_FLAG_SNAP_BEFORE
+                           : Gst::SEEK_FLAG_FLUSH | Gst::SEEK_FLAG_ACCURATE;
+    auto event = Gst::EventSeek::create(1.0, Gst::FORMAT_TIME, flags, Gst::SEEK_TYPE_SET,
+                                        (m_startTime != undefinedTime) ? m_startTime : 0,
+                                        (m_endTime != undefinedTime) ? Gst::SEEK_TYPE_SET : Gst::SEEK_TYPE_NONE,
+                                        (m_endTime != undefinedTime) ? m_endTime : 0);
+
+    for (auto& connector : m_connectors)
+    {
+        if (connector.sendUpstreamEvent(event))
+        {
+            return;
+        }
+    }
+
+    throw CannotSeekException();
+}
+
+void Player::checkRecycledConnectors() noexcept
+{
+    if (m_recycledConnectors == 0)
+    {
+        return;
+    }
+
+    // Recycled connectors keep their output branches only if the new source
+    // has exactly the same streams as the previous one, and if these branches
+    // still lead to encoders (which may have moved to another pipeline in the
+    // meantime). Otherwise, they are all disconnected and unused ones are
+    // dropped, so that listeners rebuild their outputs from scratch.
+    m_isRecycled = (m_connectors.size() == m_recycledConnectors) &&
+                   std::all_of(m_connectors.begin(), m_connectors.end(), [](const Connector& connector) {
+                       return connector.isAttached() && connector.isConnected();
+                   });
+
+    if (m_isRecycled)
+    {
+        ++m_recycleCount;
+    }
+    else
+    {
+        // Connectors are not move assigned (which would leak their elements
+        // in the pipeline), unused ones are destroyed with the old vector.
+        std::vector<Connector> connectors;
+        for (auto& connector : m_connectors)
+        {
+            if (connector.isAttached())
+            {
+                connector.disconnect();
+                connectors.push_back(std::move(connector));
+            }
+        }
+        m_connectors.swap(connectors);
+    }
+
+    m_recycledConnectors = 0;
+}
+
+void Player::startPlaying() noexcept
+{
+    try
+    {
+        triggerPlayerPrerolled();
+
+        for (auto& connector : m_connectors)
+        {
+            connector.unblock();
+        }
+
+        m_pendingState = State::playing;
+        m_pipeline->set_state(Gst::STATE_PLAYING);
+    }
+    catch (const std::exception& e)
+    {
+        postInitializationError(e);
+    }
+}
+
+void Player::postInitializationError(const std::exception& e) noexcept
+{
+    m_pipeline->get_bus()->post(Gst::MessageError::create(
+        m_pipeline,
+        Glib::Error(errorDomain, static_cast<int>(ErrorCode::cannotInitializePipeline), "cannot initialize pipeline"),
+        e.what()));
+}
+
 void Player::triggerPlayerPrerolled()
 {
     for (auto it = m_listeners.begin(); it != m_listeners.end();)
@@ -19,8 +19,10 @@
 #pragma once
 
 #include "Connector.h"
+#include "TrackSelection.h"
 #include <atomic>
 #include <functional>
+#include <map>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -37,6 +39,10 @@ class Player final
         cannotInitializePipeline
     };
     static const GQuark errorDomain;
+    static constexpr gint64 undefinedTime = -1;
+
+    static int getStreamingThreadCount() noexcept;
+    static int getPeakStreamingThreadCount() noexcept;
 
     Player();
     ~Player();
@@ -55,6 +61,7 @@ class Player final
     }
 
     void forEachConnector(const std::function<void(Connector&)>& cb);
+    void dumpConnectors(std::ostream& out) const;
 
     enum class State
     {
@@ -65,29 +72,133 @@ class Player final
     };
     bool hasStableState(State state) const noexcept;
 
+    // Accurate seeks start exactly at the start time (decoding from the
+    // previous key frame), key frame seeks start at the previous key frame.
+    enum class SeekMode
+    {
+        accurate,
+        keyframe
+    };
+
+    void setPlaybackRange(gint64 startTime = undefinedTime, gint64 endTime = undefinedTime,
+                          SeekMode seekMode = SeekMode::accurate);
+    gint64 getStartTime() const noexcept
+    {
+        return m_startTime;
+    }
+    gint64 getEndTime() const noexcept
+    {
+        return m_endTime;
+    }
+    SeekMode getSeekMode() const noexcept
+    {
+        return m_seekMode;
+    }
+
+    void setRecycling(bool isEnabled);
+    bool isRecyclingEnabled() const noexcept
+    {
+        return m_isRecyclingEnabled;
+    }
+    bool isRecycled() const noexcept
+    {
+        return m_isRecycled;
+    }
+    unsigned int getRecycleCount() const noexcept
+    {
+        return m_recycleCount;
+    }
+    void releaseConnectors();
+
     void play(const Glib::ustring& uri);
+    void preroll(const Glib::ustring& uri);
+    void resume();
     void stop() noexcept;
 
+    const Glib::ustring& getUri() const noexcept
+    {
+        return m_uri;
+    }
+    bool isHeld() const noexcept
+    {
+        return m_isHeld;
+    }
+
+    void setDecoderThreadLimit(int n = 0) noexcept;
+    void setPassthroughCaps(const Glib::RefPtr<Gst::Caps>& caps = Glib::RefPtr<Gst::Caps>());
+    void setStreamTypes(GstStreamType streamTypes = GST_STREAM_TYPE_UNKNOWN);
+    void setTrackSelections(const std::vector<TrackSelection>& videoTracks = std::vector<TrackSelection>(),
+                            const std::vector<TrackSelection>& audioTracks = std::vector<TrackSelection>());
+
+    int getThreadCount() const noexcept
+    {
+        return m_streamingThreads;
+    }
+    int getPeakThreadCount() const noexcept
+    {
+        return m_peakStreamingThreads;
+    }
+
   private:
     Glib::RefPtr<Gst::Pipeline> m_pipeline;
     unsigned int m_busWatchId;
 
     Glib::RefPtr<Gst::UriDecodeBin> m_uriDecodeBin;
+    Glib::ustring m_uri;
+    bool m_isHeld;
     std::atomic_int m_prerollingPads;
     std::atomic_bool m_prerollDone;
 
+    std::atomic_int m_streamingThreads;
+    std::atomic_int m_peakStreamingThreads;
+    std::atomic_int m_decoderThreadLimit;
+    Glib::RefPtr<Gst::Caps> m_passthroughCaps;
+    GstStreamType m_streamTypes;
+
+    struct Track
+    {
+        GstStreamType streamType;
+        int index;
+        bool isSkipped;
+    };
+    std::vector<TrackSelection> m_videoTracks;
+    std::vector<TrackSelection> m_audioTracks;
+    std::map<std::string, Track> m_tracks;
+    std::mutex m_tracksLock;
+
     std::vector<Connector> m_connectors;
     std::mutex m_connectorsWriteLock;
 
+    bool m_isRecyclingEnabled;
+    bool m_isRecycled;
+    size_t m_recycledConnectors;
+    unsigned int m_recycleCount;
+
     std::vector<std::weak_ptr<IPlayerListener>> m_listeners;
 
+    gint64 m_startTime;
+    gint64 m_endTime;
+    SeekMode m_seekMode;
+
     State m_currentState;
     State m_pendingState;
     bool m_interrupted;
 
     bool onBusMessage(const Glib::RefPtr<Gst::Bus>& bus, const Glib::RefPtr<Gst::Message>& message) noexcept;
+    Gst::BusSyncReply onSyncBusMessage(const Glib::RefPtr<Gst::Bus>& bus,
+                                       const Glib::RefPtr<Gst::Message>& message) noexcept;
     void onPadAdded(const Glib::RefPtr<Gst::Pad>& pad) noexcept;
+    static gboolean onAutoplugContinue(GstElement* bin, GstPad* pad, GstCaps* caps, Player* player) noexcept;
+    static int onAutoplugSelect(GstElement* bin, GstPad* pad, GstCaps* caps, GstElementFactory* factory,
+                                Player* player) noexcept;
+    static void onDeepElementAdded(GstBin* bin, GstBin* subBin, GstElement* element, Player* player) noexcept;
     void onPadPrerolled() noexcept;
+    Track& getTrack(GstStreamType streamType, const std::string& streamId);
+    bool selectTrack(GstStreamType streamType, GstPad* pad, bool isDecoder) noexcept;
+    void seekToPlaybackRange();
+    void checkRecycledConnectors() noexcept;
+    void startPlaying() noexcept;
+    void postInitializationError(const std::exception& e) noexcept;
 
     void triggerPlayerPrerolled();
     void triggerPlayerPlaying() noexcept;
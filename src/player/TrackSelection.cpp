@@ -0,0 +1,97 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TrackSelection.h"
+#include <algorithm>
+
+namespace
+{
+// ISO 639 codes have two or three letters.
+bool isLanguageCode(const std::string& pattern) noexcept
+{
+    return (pattern.size() >= 2) && (pattern.size() <= 3) &&
+           std::all_of(pattern.begin(), pattern.end(), [](char c) { return g_ascii_isalpha(c) != FALSE; });
+}
+} // namespace
+
+void TrackSelection::addIndex(int index)
+{
+    if (std::find(m_indexes.begin(), m_indexes.end(), index) == m_indexes.end())
+    {
+        m_indexes.push_back(index);
+    }
+}
+
+void TrackSelection::addPattern(const std::string& pattern)
+{
+    if (std::find(m_patterns.begin(), m_patterns.end(), pattern) == m_patterns.end())
+    {
+        m_patterns.push_back(pattern);
+    }
+}
+
+bool TrackSelection::isSelected(int index, const std::string& streamId, const char* language) const noexcept
+{
+    if (empty() || (std::find(m_indexes.begin(), m_indexes.end(), index) != m_indexes.end()))
+    {
+        return true;
+    }
+
+    return std::any_of(m_patterns.begin(), m_patterns.end(), [&streamId, language](const std::string& pattern) {
+        if (g_pattern_match_simple(pattern.c_str(), streamId.c_str()) != FALSE)
+        {
+            return true;
+        }
+
+        if (language == nullptr)
+        {
+            return isLanguageCode(pattern);
+        }
+
+        return g_ascii_strcasecmp(pattern.c_str(), language) == 0;
+    });
+}
+
+bool TrackSelection::operator==(const TrackSelection& other) const noexcept
+{
+    return (m_indexes == other.m_indexes) && (m_patterns == other.m_patterns);
+}
+
+bool TrackSelection::getLanguage(GstPad* pad, std::string& language) noexcept
+{
+    // Stream tags are sticky events, there can be several of them (global
+    // tags are sent separately).
+    GstEvent* event = nullptr;
+    for (guint i = 0; (event = gst_pad_get_sticky_event(pad, GST_EVENT_TAG, i)) != nullptr; ++i)
+    {
+        GstTagList* tags = nullptr;
+        gst_event_parse_tag(event, &tags);
+
+        gchar* code = nullptr;
+        const bool found = (gst_tag_list_get_string(tags, GST_TAG_LANGUAGE_CODE, &code) != FALSE);
+        gst_event_unref(event);
+        if (found)
+        {
+            language = code;
+            g_free(code);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,63 @@
+/**
+ * dubby-dub
+ *
+ * Copyright (C) 2020, Loïc Le Page
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+
+// Selection of the source tracks of one type (video or audio), by index among
+// the tracks of that type, by language tag or by stream-id pattern. An empty
+// selection selects all the tracks.
+class TrackSelection final
+{
+  public:
+    void addIndex(int index);
+    void addPattern(const std::string& pattern);
+
+    bool empty() const noexcept
+    {
+        return m_indexes.empty() && m_patterns.empty();
+    }
+    const std::vector<int>& getIndexes() const noexcept
+    {
+        return m_indexes;
+    }
+    const std::vector<std::string>& getPatterns() const noexcept
+    {
+        return m_patterns;
+    }
+
+    // The language is nullptr when it is not known yet, the track is then
+    // selected if any pattern looks like a language code (2 or 3 letters).
+    bool isSelected(int index, const std::string& streamId, const char* language) const noexcept;
+
+    bool operator==(const TrackSelection& other) const noexcept;
+    bool operator!=(const TrackSelection& other) const noexcept
+    {
+        return !(*this == other);
+    }
+
+    // Language tag of the stream going through the pad, if already known.
+    static bool getLanguage(GstPad* pad, std::string& language) noexcept;
+
+  private:
+    std::vector<int> m_indexes;
+    std::vector<std::string> m_patterns;
+};